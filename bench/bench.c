@@ -0,0 +1,390 @@
+/**
+ * bench.c - Benchmark suite for scream
+ *
+ * Builds scream.c into the same program (its main() is compiled out) and
+ * times the hot paths against bench/bin/screen, a stand-in that fakes
+ * screen's listing, create and kill:
+ *
+ *   fetch_list     parse `screen -list` output (the fallback path)
+ *   fetch_native   read the socket directory
+ *   launch         start a project template with one component per session
+ *   discovery      cold project discovery walk, one project per session
+ *   render_full    full redraw of the session list
+ *   render_scroll  move the selection down one row and redraw
+ *   filter         type a list filter key by key, redrawing each time
+ *   proc_scan      sweep /proc and attribute usage to the sessions
+ *
+ * at 10, 100, 1000 and 10000 sessions (BENCH_SIZES overrides the list).
+ * Each result line is "metric sessions median_us runs"; with BENCH_BASELINE
+ * pointing at an earlier report the change against it is appended.
+ * A few correctness checks run first and fail the run when they break.
+ */
+
+#define SCREAM_NO_MAIN
+#include "../scream.c"
+
+#define BENCH_MIN_RUNS 5
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_MAX_RUNS 1000
+
+/* One metric of a baseline report */
+typedef struct {
+    char metric[64];
+    int sessions;
+    double median_us;
+} BenchResult;
+
+BenchResult *baseline = NULL;
+int baseline_count = 0;
+int baseline_capacity = 0;
+char bench_root[MAX_PATH_LENGTH / 2];
+
+/* Read an earlier report so results can be compared against it */
+void load_baseline(const char *path) {
+    char line[MAX_LINE_LENGTH];
+    FILE *fp = fopen(path, "r");
+
+    if (fp == NULL) {
+        fprintf(stderr, "bench: cannot read baseline %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        BenchResult result;
+
+        if (line[0] != '#' && sscanf(line, "%63s %d %lf", result.metric, &result.sessions, &result.median_us) == 3) {
+            baseline = grow_array(baseline, &baseline_capacity, baseline_count, sizeof(BenchResult));
+            baseline[baseline_count++] = result;
+        }
+    }
+    fclose(fp);
+}
+
+/* Print one result, with the change against the baseline when there is one */
+void report(const char *metric, int sessions, double *samples, int runs) {
+    double median;
+    int i;
+
+    qsort(samples, runs, sizeof(double), compare_doubles);
+    median = samples[runs / 2];
+
+    printf("%-14s %6d %12.1f %5d", metric, sessions, median, runs);
+    for (i = 0; i < baseline_count; i++) {
+        if (baseline[i].sessions == sessions && strcmp(baseline[i].metric, metric) == 0 &&
+            baseline[i].median_us > 0) {
+            double change = (median - baseline[i].median_us) / baseline[i].median_us * 100.0;
+
+            printf("   baseline %12.1f  %+6.1f%%%s", baseline[i].median_us, change,
+                   change > 10.0 ? "  SLOWER" : "");
+            break;
+        }
+    }
+    putchar('\n');
+    fflush(stdout);
+}
+
+/*
+ * Time a function repeatedly: at least BENCH_MIN_RUNS runs and
+ * BENCH_MIN_SECONDS in total, or a single run when once is set.
+ */
+void measure(const char *metric, int sessions, void (*body)(int), int once) {
+    double samples[BENCH_MAX_RUNS];
+    double total = 0;
+    int runs = 0;
+
+    while (runs < BENCH_MAX_RUNS) {
+        double start = monotonic_us();
+
+        body(sessions);
+        samples[runs] = monotonic_us() - start;
+        total += samples[runs++];
+
+        if (once || (runs >= BENCH_MIN_RUNS && total >= BENCH_MIN_SECONDS * 1e6)) {
+            break;
+        }
+    }
+
+    report(metric, sessions, samples, runs);
+}
+
+/* Run a shell-free command and wait for it */
+void bench_run(char *const argv[]) {
+    SpawnResult result;
+
+    spawn_command(argv, 0, &result);
+}
+
+/* Fresh scratch directory below bench_root */
+void bench_dir(const char *name, char *path, size_t len) {
+    char *argv[] = { "rm", "-rf", path, NULL };
+
+    snprintf(path, len, "%s/%s", bench_root, name);
+    bench_run(argv);
+    mkdir(path, 0700);
+}
+
+/* screen -list with the stand-in printing the requested number of sessions */
+void setup_fetch_list(int sessions) {
+    char value[16];
+
+    snprintf(value, sizeof(value), "%d", sessions);
+    setenv("FAKE_SCREEN_SESSIONS", value, 1);
+}
+
+void run_fetch_list(int sessions) {
+    (void)sessions;
+    fetch_screens_list();
+}
+
+/* A socket directory with one FIFO per session, all owned by this (live) process */
+void setup_fetch_native(int sessions) {
+    char dir[MAX_PATH_LENGTH];
+    char path[MAX_PATH_LENGTH + 64];
+    int i;
+
+    bench_dir("sockets", dir, sizeof(dir));
+    for (i = 0; i < sessions; i++) {
+        snprintf(path, sizeof(path), "%s/%d.bench-session-%05d", dir, (int)getpid(), i);
+        mkfifo(path, i % 7 == 0 ? 0700 : 0600);
+    }
+    setenv("SCREENDIR", dir, 1);
+}
+
+void run_fetch_native(int sessions) {
+    (void)sessions;
+    fetch_screens_native();
+}
+
+/* Template errors must name their real line, blank lines included */
+int check_template_lines() {
+    const char *text = "[template web]\ncomponents = api\n\n\n\nbroken line\n";
+    const char *expected = "check:6: expected key = value inside a template";
+    TemplateBuilder builder;
+    int ok;
+
+    memset(&builder, 0, sizeof(builder));
+    builder_string(&builder, "");
+    builder_parse(&builder, text, "check");
+    ok = builder.errors == 1 && strcmp(builder.first_error, expected) == 0;
+    if (!ok) {
+        fprintf(stderr, "bench: template error reported as \"%s\", expected \"%s\"\n",
+                builder.first_error, expected);
+    }
+    free_builder(&builder);
+    return ok;
+}
+
+/* A template with one component per session */
+void setup_launch(int sessions) {
+    TemplateBuilder builder;
+    char dir[MAX_PATH_LENGTH];
+    char *text;
+    size_t size;
+    int i, len = 0;
+
+    /* An empty socket directory keeps the existence checks cheap */
+    bench_dir("sockets", dir, sizeof(dir));
+    setenv("SCREENDIR", dir, 1);
+
+    text = malloc(64 + sessions * 32);
+    len = sprintf(text, "[template bench]\ncomponents =");
+    for (i = 0; i < sessions; i++) {
+        len += sprintf(text + len, " c%05d", i);
+    }
+    strcpy(text + len, "\n");
+
+    memset(&builder, 0, sizeof(builder));
+    builder_string(&builder, "");
+    builder_parse(&builder, text, "bench");
+    free(template_image);
+    template_image = builder_image(&builder, &size);
+    template_image_size = size;
+    projects_from_image(template_image, size);
+    free_builder(&builder);
+    free(text);
+}
+
+void run_launch(int sessions) {
+    (void)sessions;
+    create_project_screens(0);
+}
+
+/* A tree of project directories, 100 per group, each with a marker file */
+void setup_discovery(int sessions) {
+    char root[MAX_PATH_LENGTH];
+    char path[MAX_PATH_LENGTH + 64];
+    int i;
+
+    bench_dir("tree", root, sizeof(root));
+    for (i = 0; i < sessions; i++) {
+        FILE *fp;
+
+        snprintf(path, sizeof(path), "%s/group-%03d", root, i / 100);
+        mkdir(path, 0700);
+        snprintf(path, sizeof(path), "%s/group-%03d/project-%05d", root, i / 100, i);
+        mkdir(path, 0700);
+        strcat(path, "/CLAUDE.md");
+        fp = fopen(path, "w");
+        if (fp != NULL) {
+            fclose(fp);
+        }
+    }
+
+    setenv("SCREAM_PROJECT_ROOTS", root, 1);
+    setenv("SCREAM_PROJECT_MARKERS", "CLAUDE.md", 1);
+}
+
+void run_discovery(int sessions) {
+    DiscoveryConfig config;
+    DirRecord *records = NULL;
+    int count;
+
+    (void)sessions;
+    discovery_config_load(&config);
+    count = discovery_walk(&config, NULL, 0, &records);
+    free_dir_records(records, count);
+}
+
+/* The session table filled with synthetic sessions, browse menu at the top */
+void setup_render(int sessions) {
+    Screen screen;
+    int i;
+
+    screen_table_clear();
+    for (i = 0; i < sessions; i++) {
+        char id[64];
+        int len = snprintf(id, sizeof(id), "%d.bench-session-%05d", 100000 + i, i);
+        
+        screen_init(&screen, id, len, 1792227600 + i);
+        screen.state = i % 7 == 0 ? SCREEN_ATTACHED : SCREEN_DETACHED;
+        screen_table_add(&screen);
+    }
+
+    current_menu = MENU_BROWSE;
+    selected_index = 0;
+    screen_top = 0;
+    needs_full_redraw = 1;
+    draw_current_menu();
+}
+
+void run_render_full(int sessions) {
+    (void)sessions;
+    needs_full_redraw = 1;
+    draw_current_menu();
+}
+
+void run_render_scroll(int sessions) {
+    (void)sessions;
+    handle_input(KEY_DOWN);
+    draw_current_menu();
+}
+
+void run_proc_scan(int sessions) {
+    (void)sessions;
+    proc_scan();
+}
+
+void run_filter(int sessions) {
+    const char *keys = "/session-9";
+    
+    (void)sessions;
+    for (; *keys != '\0'; keys++) {
+        handle_input(*keys);
+        draw_current_menu();
+    }
+    handle_input(27);
+}
+
+int main() {
+    char exe[MAX_PATH_LENGTH];
+    char path[MAX_PATH_LENGTH * 2];
+    const char *sizes = getenv("BENCH_SIZES");
+    char *copy, *item, *save;
+    ssize_t len;
+    SCREEN *term;
+    FILE *out, *in;
+    time_t now = time(NULL);
+
+    /* The stand-in screen lives next to this binary */
+    len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len <= 0) {
+        fprintf(stderr, "bench: cannot locate executable\n");
+        return EXIT_FAILURE;
+    }
+    exe[len] = '\0';
+    *strrchr(exe, '/') = '\0';
+    snprintf(path, sizeof(path), "%s:%s", exe, getenv("PATH") ? getenv("PATH") : "/usr/bin:/bin");
+    setenv("PATH", path, 1);
+
+    snprintf(bench_root, sizeof(bench_root), "%s/scream-bench-XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (mkdtemp(bench_root) == NULL) {
+        perror("bench: mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    if (!check_template_lines()) {
+        return EXIT_FAILURE;
+    }
+
+    if (getenv("FAKE_SCREEN_LATENCY_MS") == NULL) {
+        setenv("FAKE_SCREEN_LATENCY_MS", "2", 1);
+    }
+    if (getenv("BENCH_BASELINE") != NULL) {
+        load_baseline(getenv("BENCH_BASELINE"));
+    }
+
+    /* Render into a fixed-size terminal that discards its output */
+    setenv("LINES", "50", 1);
+    setenv("COLUMNS", "160", 1);
+    out = fopen("/dev/null", "w");
+    in = fopen("/dev/null", "r");
+    term = newterm("xterm", out, in);
+    if (term == NULL) {
+        fprintf(stderr, "bench: cannot initialize the xterm terminal description\n");
+        return EXIT_FAILURE;
+    }
+    start_color();
+
+    printf("# scream bench %s", ctime(&now));
+    printf("# screen latency %sms, %d jobs; metric sessions median_us runs\n",
+           getenv("FAKE_SCREEN_LATENCY_MS"), max_jobs);
+
+    copy = strdup(sizes != NULL ? sizes : "10 100 1000 10000");
+    for (item = strtok_r(copy, " ,", &save); item != NULL; item = strtok_r(NULL, " ,", &save)) {
+        int sessions = atoi(item);
+
+        if (sessions <= 0) {
+            continue;
+        }
+
+        setup_fetch_list(sessions);
+        measure("fetch_list", sessions, run_fetch_list, 0);
+
+        setup_fetch_native(sessions);
+        measure("fetch_native", sessions, run_fetch_native, 0);
+
+        setup_launch(sessions);
+        measure("launch", sessions, run_launch, 1);
+
+        setup_discovery(sessions);
+        measure("discovery", sessions, run_discovery, 0);
+
+        setup_render(sessions);
+        measure("render_full", sessions, run_render_full, 0);
+        measure("render_scroll", sessions, run_render_scroll, 0);
+        measure("filter", sessions, run_filter, 0);
+        measure("proc_scan", sessions, run_proc_scan, 0);
+    }
+    free(copy);
+
+    endwin();
+    delscreen(term);
+
+    {
+        char *argv[] = { "rm", "-rf", bench_root, NULL };
+
+        bench_run(argv);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+/**
+ * fake_screen.c - Stand-in for GNU Screen used by the benchmark suite
+ *
+ * Understands just enough of screen's command line for scream:
+ *   screen -list | -ls         synthetic listing of FAKE_SCREEN_SESSIONS sessions
+ *   screen -dmS NAME [...]     pretend to create a session
+ *   screen -S ID -X quit       pretend to kill a session
+ *
+ * Create and kill sleep for FAKE_SCREEN_LATENCY_MS milliseconds first, so
+ * launch benchmarks see a realistic per-command cost without a real server.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Integer setting from the environment */
+static long env_long(const char *name, long fallback) {
+    const char *value = getenv(name);
+
+    return value != NULL && *value != '\0' ? atol(value) : fallback;
+}
+
+/* Sleep for the configured command latency */
+static void fake_latency() {
+    long ms = env_long("FAKE_SCREEN_LATENCY_MS", 0);
+    struct timespec ts;
+
+    if (ms > 0) {
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = (ms % 1000) * 1000000L;
+        nanosleep(&ts, NULL);
+    }
+}
+
+/* Print a listing in the format of screen 4.x */
+static int fake_list() {
+    long count = env_long("FAKE_SCREEN_SESSIONS", 0);
+    static char buf[1 << 16];
+    long i;
+
+    setvbuf(stdout, buf, _IOFBF, sizeof(buf));
+
+    if (count <= 0) {
+        printf("No Sockets found in /run/screen/S-bench.\n\n");
+        return 1;
+    }
+
+    printf("There %s on:\n", count == 1 ? "is a screen" : "are screens");
+    for (i = 0; i < count; i++) {
+        printf("\t%ld.bench-session-%05ld\t(10/17/2026 09:%02ld:%02ld AM)\t(%s)\n",
+               100000 + i, i, (i / 60) % 60, i % 60, i % 7 == 0 ? "Attached" : "Detached");
+    }
+    printf("%ld Socket%s in /run/screen/S-bench.\n\n", count, count == 1 ? "" : "s");
+
+    /* screen exits non-zero after listing sessions */
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && (strcmp(argv[1], "-list") == 0 || strcmp(argv[1], "-ls") == 0)) {
+        return fake_list();
+    }
+
+    if (argc > 2 && strcmp(argv[1], "-dmS") == 0) {
+        fake_latency();
+        return 0;
+    }
+
+    if (argc > 4 && strcmp(argv[1], "-S") == 0 && strcmp(argv[3], "-X") == 0) {
+        fake_latency();
+        return 0;
+    }
+
+    fprintf(stderr, "fake screen: unsupported arguments\n");
+    return 1;
+}
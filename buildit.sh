@@ -1,4 +1,4 @@
 #!/bin/bash
 
-gcc -o scream scream.c -lncurses
+gcc -o scream scream.c -lncurses -lpthread
 sudo ln -s ./scream /usr/bin/scream
@@ -1,11 +1,14 @@
 /**
  * scream.c - A Comprehensive Screen Session Management Tool
  * 
- * Compile with: gcc -o scream scream.c -lncurses
+ * Compile with: gcc -o scream scream.c -lncurses -lpthread
  * Run with: ./scream
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -15,13 +18,47 @@
 #include <time.h>
 #include <signal.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 
-#define MAX_SCREENS 100
 #define MAX_LINE_LENGTH 256
-#define MAX_CMD_LENGTH 1024
-#define MAX_PROJECTS 50
 #define MAX_NAME_LENGTH 64
-#define MAX_PROJECT_ENTRIES 100
+#define MAX_PATH_LENGTH 4096
+#define MAX_DIRTY_ROWS 16
+#define LIST_START_Y 4
+#define DEFAULT_MAX_JOBS 4
+#define DEFAULT_DISCOVERY_THREADS 8
+#define TEMPLATE_CACHE_MAGIC "SCRMTPL1"
+#define TEMPLATE_CACHE_VERSION 2
+#define DAEMON_MAX_REQUEST 1024
+#define LIST_READ_CHUNK 65536
+#define PROC_SCAN_INTERVAL_MS 2000
+#define WINDOW_QUERY_TIMEOUT_MS 1000
+#define MAX_WINDOW_QUERIES 32
+#define MAX_POLL_FDS 128
+#define OPS_REFRESH_MS 500
+#define TMUX_CONTROL_SESSION "scream-control"
+#define TMUX_REPLY_TIMEOUT_MS 5000
+#define SCREEN_SEND_TIMEOUT_MS 1000
+#define MAX_SCREEN_CONNS 16
+#define SHELL_AFTER "; exec \"${SHELL:-/bin/sh}\""
+#define SNAPSHOT_VERSION 1
 
 /* Color pairs */
 #define COLOR_HEADER 1
@@ -33,6 +70,33 @@
 #define COLOR_ERROR 7
 #define COLOR_SUCCESS 8
 
+/* Batch job states */
+#define JOB_PENDING 0
+#define JOB_RUNNING 1
+#define JOB_SKIPPED 2
+#define JOB_DONE 3
+#define JOB_FAILED 4
+#define JOB_CANCELLED 5
+#define JOB_WAITING 6   /* held back until the jobs it depends on are ready */
+#define JOB_PROBING 7   /* command succeeded, waiting for its readiness probe */
+
+/* Readiness probes of template components */
+#define READY_NONE 0
+#define READY_TCP 1
+#define READY_FILE 2
+#define READY_LOG 3
+#define READY_POLL_MS 100
+#define DEFAULT_READY_TIMEOUT 60
+
+/* What a batch job does to its target */
+#define JOB_KIND_CREATE 0
+#define JOB_KIND_KILL 1
+
+/* Replies expected on the tmux control connection */
+#define TMUX_REPLY_LIST 0
+#define TMUX_REPLY_JOB 1
+#define TMUX_REPLY_IGNORE 2
+
 /* Menu states */
 #define MENU_MAIN 0
 #define MENU_BROWSE 1
@@ -41,48 +105,600 @@
 #define MENU_PROJECT 4
 #define MENU_HELP 5
 #define MENU_PROJECT_LIST 6
+#define MENU_STATS 7
+#define MENU_LOG 8
+
+/* Instrumented hot paths (see stats[]) */
+#define STAT_FETCH 0
+#define STAT_WATCH 1
+#define STAT_TEMPLATES 2
+#define STAT_DISCOVERY 3
+#define STAT_SPAWN 4
+#define STAT_LAUNCH 5
+#define STAT_RENDER 6
+#define STAT_REQUEST 7
+#define STAT_PROC 8
+#define STAT_WINDOWS 9
+#define STAT_COUNT 10
+#define STAT_SAMPLES 256
+
+/* Session list orderings */
+#define SORT_NONE 0
+#define SORT_RSS 1
+#define SORT_CPU 2
+#define SORT_PROCS 3
+#define SORT_COUNT 4
+
+/* Window list states */
+#define WINDOWS_PENDING 0
+#define WINDOWS_READY 1
+#define WINDOWS_FAILED 2
+#define WINDOWS_TIMEOUT 3
 
-/* Screen data structure */
+/* Screen 4.x session socket protocol (struct msg in screen.h) */
+#define SCREEN_MSG_VERSION 4
+#define SCREEN_MSG_REVISION (('m' << 24) | ('s' << 16) | ('g' << 8) | SCREEN_MSG_VERSION)
+#define SCREEN_MSG_ERROR 1
+#define SCREEN_MSG_COMMAND 8
+#define SCREEN_MSG_QUERY 9
+#define SCREEN_MAXPATHLEN 4096
+#define SCREEN_MAXLOGINLEN 256
+
+/* Exit codes of the batch subcommands */
+#define EXIT_USAGE 2
+
+/* Session states */
+#define SCREEN_DETACHED 0
+#define SCREEN_ATTACHED 1
+#define SCREEN_DEAD 2
+
+/*
+ * Screen data structure. Strings live in the shared screen_strings pool and
+ * are referenced by offset, so a record stays a few words wide.
+ */
 typedef struct {
-    char full_id[64];
-    char pid[16];
-    char name[64];
-    char timestamp[32];
-    char status[16];
-    int is_attached;
+    unsigned int id;        /* "pid.name" */
+    unsigned int name;      /* inside id, or a separate "unknown" */
+    time_t created;         /* 0 if screen did not report it */
+    pid_t pid;
+    unsigned char state;
+    unsigned char marked;   /* selected for a bulk kill */
+    unsigned char filter_len;   /* longest prefix of the list filter the name matches */
+    unsigned char usage_seen;   /* usage below is from a /proc scan */
+    unsigned int rss_kb;        /* resident memory of the whole process tree */
+    unsigned short cpu;         /* CPU use of the tree in tenths of a percent */
+    unsigned short procs;       /* processes below the screen server */
+    unsigned int cpu_ticks;     /* tree CPU time at the last scan, in clock ticks */
 } Screen;
 
+/* One process from a /proc sweep */
+typedef struct {
+    pid_t pid;
+    pid_t ppid;
+    pid_t tpgid;            /* foreground process group of its terminal */
+    unsigned int ticks;     /* utime + stime */
+    unsigned int rss_kb;
+    int owner;              /* screens[] index of its session, -1 for none, -2 not yet known */
+} ProcEntry;
+
+/* One window of a session as listed by screen -Q windows */
+typedef struct {
+    int number;
+    char flags[8];          /* '*' current, '-' previous, '$' has a login, ... */
+    char title[MAX_NAME_LENGTH];
+    char command[MAX_LINE_LENGTH];  /* foreground command as of the last /proc sweep */
+} WindowInfo;
+
+/* Window list of a session, cached while its socket is unchanged */
+typedef struct {
+    pid_t pid;              /* the session's server */
+    struct timespec mtime, ctime;   /* socket times when it was queried */
+    int state;
+    pid_t query_pid;        /* running screen -Q client, -1 for a direct query, 0 when none */
+    int out_fd, err_fd;     /* a direct query has no out_fd until the server connects */
+    int listen_fd;          /* writeback socket of a direct query, -1 for a FIFO */
+    double started, deadline;
+    char *output;
+    size_t output_len, output_capacity;
+    WindowInfo *windows;
+    int window_count;
+    int window_capacity;
+} WindowCache;
+
+/* A session log mapped read-only for the log pane */
+typedef struct {
+    int open;
+    char session[MAX_NAME_LENGTH];
+    char path[MAX_PATH_LENGTH];
+    int fd;                 /* -1 until the log exists */
+    const char *data;       /* the first size bytes of the log, NULL when empty */
+    size_t size;
+    size_t top;             /* offset of the first line on screen */
+    int follow;             /* keep the last line on screen as the log grows */
+    int watch_fd;           /* inotify on the log directory, -1 without one */
+    char search[MAX_NAME_LENGTH];
+    int search_len;
+    int search_editing;
+    size_t match;           /* offset of the last match */
+    int has_match;
+} LogView;
+
+/*
+ * A message to a screen server, laid out as screen 4.x's struct msg. The
+ * create, attach and detach variants of its union are smaller than the
+ * command one, so leaving them out keeps the size equal to screen's.
+ */
+typedef struct {
+    int protocol_revision;
+    int type;
+    char m_tty[SCREEN_MAXPATHLEN];
+    union {
+        struct {
+            char auser[SCREEN_MAXLOGINLEN + 1];
+            int nargs;
+            char cmd[SCREEN_MAXPATHLEN];     /* NUL-separated arguments */
+            int apid;
+            char preselect[20];
+            char writeback[SCREEN_MAXPATHLEN];  /* where a query's reply goes */
+        } command;
+        char message[SCREEN_MAXPATHLEN * 2];
+    } m;
+} ScreenMsg;
+
+/* An open FIFO to a session server, kept for the next command */
+typedef struct {
+    pid_t pid;
+    int fd;
+} ScreenConn;
+
+/* A connection to the session daemon: a partial request line and unsent reply bytes */
+typedef struct {
+    int fd;
+    char request[DAEMON_MAX_REQUEST];
+    int request_len;
+    char *reply;
+    size_t reply_len, reply_sent, reply_capacity;
+    int read_closed;    /* the client shut down its side; closed once the reply is out */
+} DaemonClient;
+
+/* Open-addressing hash index over screens[] (slots hold index + 1, 0 is empty) */
+typedef struct {
+    int *slots;
+    size_t mask;
+    unsigned long (*hash)(const Screen *screen);
+    int (*matches)(const Screen *screen, const void *key);
+} ScreenIndex;
+
+/* One session of a project template; strings point into the template image */
+typedef struct {
+    const char *name;
+    const char *command;    /* run in the session's first window, NULL for a plain shell */
+    const char *directory;  /* working directory, NULL for the current one */
+    const char **env;       /* KEY=VALUE overrides */
+    int env_count;
+    const char *depends;    /* space-separated components started first, NULL for none */
+    const char *ready;      /* readiness probe, NULL when creating the session is enough */
+    int ready_timeout;      /* seconds the probe may take, 0 for the default */
+} ProjectComponent;
+
 /* Project template structure */
 typedef struct {
-    char name[MAX_NAME_LENGTH];
-    char components[10][MAX_NAME_LENGTH];
+    const char *name;
+    ProjectComponent *components;
     int num_components;
 } Project;
 
-/* Project entry structure for list-projects */
+/*
+ * Compiled template cache: a header followed by the source list, templates,
+ * components, env offsets and a string pool. Native byte order; strings are
+ * offsets into the pool, where offset 0 is the empty string (meaning unset).
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t defaults_hash;
+    uint32_t source_count;
+    uint32_t template_count;
+    uint32_t component_count;
+    uint32_t env_count;
+    uint32_t strings_size;
+    uint32_t pad;
+} TemplateCacheHeader;
+
+typedef struct {
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t size;
+    uint32_t path;
+    uint32_t pad;
+} TemplateCacheSource;
+
+typedef struct {
+    uint32_t name;
+    uint32_t first_component;
+    uint32_t component_count;
+} TemplateCacheTemplate;
+
+typedef struct {
+    uint32_t name;
+    uint32_t command;
+    uint32_t directory;
+    uint32_t first_env;
+    uint32_t env_count;
+    uint32_t depends;
+    uint32_t ready;
+    uint32_t ready_timeout;
+} TemplateCacheComponent;
+
+/* Growable tables used while compiling template files */
 typedef struct {
-    char key[MAX_NAME_LENGTH];
-    char directory[MAX_LINE_LENGTH];
+    TemplateCacheSource *sources;
+    int source_count, source_capacity;
+    TemplateCacheTemplate *templates;
+    int template_count, template_capacity;
+    TemplateCacheComponent *components;
+    int component_count, component_capacity;
+    uint32_t *env;
+    int env_count, env_capacity;
+    char *strings;
+    int strings_size, strings_capacity;
+    int errors;
+    char first_error[MAX_LINE_LENGTH];
+} TemplateBuilder;
+
+/* Project entry structure for discovered project directories */
+typedef struct {
+    char *key;
+    char *directory;
 } ProjectEntry;
 
+/* Project discovery settings (colon-separated lists from the environment) */
+typedef struct {
+    char **roots;
+    int root_count;
+    char **markers;
+    int marker_count;
+    char **prune;
+    int prune_count;
+    int threads;
+} DiscoveryConfig;
+
+/* A directory seen by the walker; the on-disk cache is a list of these */
+typedef struct {
+    char *path;
+    struct timespec mtime;
+    int root_len;
+    int is_project;
+    char *key;      /* resolved lazily for projects */
+    char *real;
+} DirRecord;
+
+/* A directory waiting to be scanned; cached is set when revalidating a known directory */
+typedef struct {
+    char *path;
+    int root_len;
+    const DirRecord *cached;
+} DiscoveryItem;
+
+/* Set of directory paths known from the cache */
+typedef struct {
+    const char **slots;
+    size_t mask;
+} PathSet;
+
+/* Shared state of one parallel directory walk */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    DiscoveryItem *queue;
+    int queue_count;
+    int queue_capacity;
+    int busy;
+    DirRecord *records;
+    int record_count;
+    int record_capacity;
+    PathSet known;
+    const DiscoveryConfig *config;
+} DiscoveryWalk;
+
+/* Outcome of a spawned command */
+typedef struct {
+    int status;                  /* exit status, or -1 if it could not be started */
+    char error[MAX_LINE_LENGTH]; /* first line the command wrote to stderr */
+} SpawnResult;
+
+/* One session command in a bounded-concurrency batch */
+typedef struct {
+    char target[MAX_LINE_LENGTH];   /* session name to create, or id to kill */
+    int kind;
+    const ProjectComponent *component;  /* template component being launched, if any */
+    char *argv[12];
+    char *cwd;      /* optional, owned by the job */
+    char **envp;    /* optional, the array is owned by the job */
+    char *logfile;  /* optional session log, owned by the job */
+    char *script;   /* optional sh -c script, owned by the job */
+    pid_t pid;      /* 0 when the backend runs the command without a child */
+    int pidfd;      /* readable once the child exits; -1 when SIGCHLD reports it */
+    int err_fd;
+    int state;
+    double started;  /* monotonic start time, for the spawn timer */
+    SpawnResult result;
+    int *depends;    /* indices of jobs in the same operation to wait for, owned by the job */
+    int depend_count;
+    int ready_kind;  /* READY_*: probe that must pass before the job counts as done */
+    int ready_port;
+    char *ready_path;        /* file a file or log probe watches, owned by the job */
+    const char *ready_text;  /* line a log probe waits for */
+    off_t ready_offset;      /* log bytes already searched */
+    int ready_fd;            /* connecting socket of a tcp probe, -1 when none */
+    int ready_timeout;       /* seconds */
+    double ready_deadline;
+} Job;
+
+/*
+ * A batch of jobs queued to the executor. Jobs of all operations share the
+ * max_jobs limit; complete runs on the main loop once every job has ended.
+ */
+typedef struct Operation {
+    char label[MAX_LINE_LENGTH];
+    Job *jobs;
+    int job_count;
+    int finished;   /* jobs that are no longer pending or running */
+    int cancelled;
+    int owns_jobs;  /* jobs is freed along with the operation */
+    int waited;     /* op_wait frees it rather than the executor */
+    int done;
+    void (*complete)(struct Operation *op);
+    double started;
+} Operation;
+
+/*
+ * A session multiplexer. fetch refills the session table; watch_init points
+ * watch_fd at something poll() reports session changes on, and
+ * watch_process applies them. start_job begins a create or kill job and
+ * attach runs the multiplexer in the foreground on a session.
+ */
+typedef struct {
+    const char *name;
+    void (*fetch)();
+    void (*watch_init)();
+    int (*watch_process)();
+    int (*start_job)(Job *job);
+    void (*attach)(const Screen *screen);
+    int has_processes;  /* session pids are process ids, for the usage columns and window pane */
+} SessionBackend;
+
+/* A command sent over the tmux control connection, waiting for its %end or %error */
+typedef struct {
+    int kind;
+    Job *job;
+} TmuxReply;
+
+/* Project discovery running on a background thread, reported through an eventfd */
+typedef struct {
+    pthread_t thread;
+    int event_fd;
+    int running;
+    int full;
+    const DirRecord *cached;
+    int cached_count;
+    DirRecord *records;
+    int count;
+    double started;
+} DiscoveryTask;
+
+/* One window of a snapshot session; the strings are malloc'd */
+typedef struct {
+    int number;
+    char *cwd;
+    char *command;  /* shell command line, empty for a plain shell */
+} SnapshotWindow;
+
+/* A session as recorded by scream snapshot */
+typedef struct {
+    char *name;
+    char *template; /* template it was launched from, empty for none */
+    SnapshotWindow *windows;    /* by window number */
+    int window_count;
+    int window_capacity;
+} SnapshotSession;
+
+/* Latency counters for one hot path; p99 comes from the most recent samples */
+typedef struct {
+    unsigned long count;
+    double last_us;
+    double total_us;
+    double max_us;
+    double samples[STAT_SAMPLES];
+} Stat;
+
+extern char **environ;
+
 /* Global variables */
-Screen screens[MAX_SCREENS];
+Screen *screens = NULL;
 int screen_count = 0;
+int screen_capacity = 0;
 int selected_index = 0;
 int current_menu = MENU_MAIN;
 char status_message[MAX_LINE_LENGTH] = "";
 int status_type = COLOR_NORMAL;
-Project projects[MAX_PROJECTS];
+Project *projects = NULL;
 int project_count = 0;
+ProjectComponent *project_components = NULL;  /* backing arrays for projects[] */
+const char **project_env = NULL;
+void *template_image = NULL;
+size_t template_image_size = 0;
+int template_image_mapped = 0;
+const char *default_templates =
+    "[template web-app]\n"
+    "components = db api frontend\n"
+    "[template data-science]\n"
+    "components = jupyter data-processor visualization\n"
+    "[template microservices]\n"
+    "components = auth-service api-gateway user-service notification-service logging-service\n"
+    "[template devops]\n"
+    "components = monitoring build-server staging deployment\n";
 int selected_project = 0;
 char new_screen_name[MAX_NAME_LENGTH] = "";
 int cursor_pos = 0;
-ProjectEntry project_entries[MAX_PROJECT_ENTRIES];
+ProjectEntry *project_entries = NULL;
 int project_entry_count = 0;
+DiscoveryConfig discovery_config;
+int discovery_config_loaded = 0;
+DirRecord *discovery_records = NULL;
+int discovery_record_count = 0;
+int project_revalidate_pending = 0;
 int selected_project_entry = 0;
+int screen_top = 0;
+int project_top = 0;
+int project_entry_top = 0;
+int needs_full_redraw = 1;
+int dirty_rows[MAX_DIRTY_ROWS];
+int dirty_count = 0;
+unsigned long screen_name_hash(const Screen *screen);
+int screen_name_matches(const Screen *screen, const void *key);
+unsigned long screen_pid_hash(const Screen *screen);
+int screen_pid_matches(const Screen *screen, const void *key);
+ScreenIndex name_index = { NULL, 0, screen_name_hash, screen_name_matches };
+ScreenIndex pid_index = { NULL, 0, screen_pid_hash, screen_pid_matches };
+char *screen_strings = NULL;
+size_t screen_strings_size = 0;
+size_t screen_strings_capacity = 0;
+size_t screen_strings_garbage = 0;
+const char *screen_state_names[] = { "Detached", "Attached", "Dead" };
+int watch_fd = -1;
+int watch_wd = -1;
+char watch_dir[MAX_PATH_LENGTH] = "";
+int max_jobs = DEFAULT_MAX_JOBS;
+Job *launch_jobs = NULL;
+int launch_job_count = 0;
+int launch_project = -1;
+Operation **operations = NULL;   /* in submission order */
+int operation_count = 0;
+int operation_capacity = 0;
+int running_jobs = 0;
+int ops_blocking = 1;            /* wait for operations to finish (batch modes) */
+int ops_use_pidfd = -1;          /* -1 until probed */
+int sigchld_pipe[2] = { -1, -1 };
+DiscoveryTask discovery_task = { 0, -1, 0, 0, NULL, 0, NULL, 0, 0 };
+volatile int discovery_cancel = 0;
+void screen_backend_fetch();
+void screen_watch_init();
+int screen_watch_process();
+int spawn_job(Job *job);
+void screen_attach(const Screen *screen);
+void tmux_fetch();
+void tmux_watch_init();
+int tmux_watch_process();
+int tmux_start_job(Job *job);
+void tmux_attach(const Screen *screen);
+int tmux_connect();
+void tmux_disconnect();
+void tmux_close();
+int tmux_send(const char *command, int kind, Job *job);
+void tmux_request_list();
+void tmux_quote(char *buf, size_t len, const char *text);
+int tmux_apply_list(char *output);
+int tmux_line(char *line);
+int tmux_process();
+SessionBackend screen_backend = {
+    "screen", screen_backend_fetch, screen_watch_init, screen_watch_process, spawn_job, screen_attach, 1
+};
+SessionBackend tmux_backend = {
+    "tmux", tmux_fetch, tmux_watch_init, tmux_watch_process, tmux_start_job, tmux_attach, 0
+};
+SessionBackend *backend = &screen_backend;
+pid_t tmux_pid = 0;              /* tmux -C client; its stdout is watch_fd */
+int tmux_in = -1;
+char *tmux_input = NULL;         /* unparsed bytes from the connection */
+int tmux_input_len = 0;
+int tmux_input_capacity = 0;
+char *tmux_output = NULL;        /* lines of the reply being received */
+int tmux_output_len = 0;
+int tmux_output_capacity = 0;
+int tmux_block = 0;              /* inside %begin: 1 for our commands, 2 for others */
+TmuxReply *tmux_replies = NULL;  /* in the order the commands were sent */
+int tmux_reply_count = 0;
+int tmux_reply_capacity = 0;
+int tmux_list_pending = 0;
+int tmux_list_again = 0;
+unsigned long tmux_lists_done = 0;
+int marked_count = 0;
+ScreenConn screen_conns[MAX_SCREEN_CONNS];   /* least recently opened first */
+int screen_conn_count = 0;
+int screen_direct = -1;          /* talk to session sockets ourselves; -1 until read from the environment */
+char screen_query_dir[MAX_PATH_LENGTH / 2] = "";  /* private directory for query writebacks */
+Stat stats[STAT_COUNT];
+const char *stat_names[STAT_COUNT] = {
+    "fetch sessions", "inotify update", "load templates", "discovery walk",
+    "spawn screen", "launch template", "render frame", "daemon request",
+    "proc scan", "window query"
+};
+int pattern_active = 0;
+char kill_pattern[MAX_NAME_LENGTH] = "";
+int pattern_pos = 0;
+char filter_text[MAX_NAME_LENGTH] = "";
+int filter_len = 0;
+int filter_fuzzy = 0;
+int filter_editing = 0;
+int *view_index = NULL;       /* screens[] index of each list row while filtered or sorted */
+int view_count = 0;
+int view_capacity = 0;
+int view_stale = 0;
+int list_sort = SORT_NONE;
+const char *sort_names[SORT_COUNT] = { "", "memory", "CPU", "processes" };
+ProcEntry *proc_entries = NULL;
+int proc_count = 0;
+int proc_capacity = 0;
+double proc_last_scan = 0;
+WindowCache *window_cache = NULL;
+int window_cache_count = 0;
+int window_cache_capacity = 0;
+int window_queries = 0;
+int window_pane = 0;
+LogView log_view;
 
 /* Function prototypes */
+unsigned long hash_string(const char *str);
+unsigned long hash_pid(pid_t pid);
+void screen_index_insert(ScreenIndex *index, int i);
+void screen_index_remove(ScreenIndex *index, int i);
+void screen_index_move(ScreenIndex *index, int from, int to);
+void screen_index_rebuild(ScreenIndex *index, size_t nslots);
+int screen_index_find(const ScreenIndex *index, unsigned long hash, const void *key);
+const char *screen_id(const Screen *screen);
+const char *screen_name(const Screen *screen);
+int screen_init(Screen *screen, const char *id, size_t id_len, time_t created);
+void screen_free(Screen *screen);
+void screen_strings_compact();
+int screen_parse_state(const char *text, size_t len);
+time_t screen_parse_time(const char *text, size_t len);
+void screen_format_time(const Screen *screen, char *buf, size_t len);
+int screen_table_add(const Screen *screen);
+void screen_table_remove(int i);
+void screen_table_clear();
+int screen_find_by_name(const char *name);
+int screen_find_by_pid(pid_t pid);
+int backend_select(const char *name);
 void fetch_screens();
+int fetch_screens_native();
+void fetch_screens_list();
+int parse_list_line(const char *line, size_t len, Screen *screen);
+int screen_socket_dir(char *buf, size_t len);
+int socket_entry_stat(const char *dir, const char *entry, time_t *created, unsigned char *state);
+int parse_socket_entry(const char *dir, const char *entry, Screen *screen);
+void watch_init();
+int watch_process();
+int screen_apply_socket_event(const char *entry);
+void draw_current_menu();
+int list_rows();
+void list_clamp(int *selected, int *top, int count, int rows);
+void list_move(int *selected, int *top, int count, int delta);
+void mark_dirty_row(int index);
+void draw_session_list(WINDOW *win, const char *title, const char *help);
+void draw_screen_row(int i);
+void draw_project_entry_row(int i);
+void draw_status_line(int height);
 void draw_menu(WINDOW *win);
 void draw_screens(WINDOW *win);
 void draw_create_menu(WINDOW *win);
@@ -92,19 +708,229 @@ void draw_help_menu(WINDOW *win);
 void draw_project_list_menu(WINDOW *win);
 void activate_screen(int index);
 void kill_screen(int index);
+void kill_job_init(Job *job, const char *id);
+void create_job_init(Job *job, const char *name);
+void create_job_script(Job *job);
+int session_log_enabled();
+int session_log_path(const char *name, char *buf, size_t len);
+int screen_logfile_supported();
+void log_open(const char *session);
+void log_close();
+void log_refresh(int reopen);
+int log_process();
+size_t log_line_start(size_t offset);
+size_t log_line_prev(size_t offset);
+size_t log_line_next(size_t offset);
+size_t log_tail(int rows);
+void log_scroll(int lines);
+int log_render_line(const char *p, const char *end, char *out, int width);
+void log_search(int backward);
+void handle_log_input(int ch);
+void draw_log_menu(WINDOW *win);
 void create_screen(char *name);
 void load_projects();
+void *grow_array(void *array, int *capacity, int count, size_t size);
+int template_source_list(char ***paths);
+uint32_t builder_string(TemplateBuilder *b, const char *str);
+void builder_error(TemplateBuilder *b, const char *origin, int line, const char *what);
+void builder_parse(TemplateBuilder *b, const char *text, const char *origin);
+void *builder_image(TemplateBuilder *b, size_t *size);
+void free_builder(TemplateBuilder *b);
+int template_image_valid(const void *image, size_t size, char **paths, int count);
+int projects_from_image(const void *image, size_t size);
+char *expand_home(const char *path);
+char **build_environment(const ProjectComponent *component, const char *template);
+void free_job_resources(Job *job);
+int ready_parse(const char *spec, int *port, char *path, size_t len, const char **text);
 void create_project_screens(int project_index);
 void load_project_entries();
+void revalidate_project_entries(int full);
+void apply_discovery(DirRecord *records, int count, const char *verb);
+char **split_list(const char *value, const char *fallback, int *count);
+void discovery_config_load(DiscoveryConfig *config);
+unsigned long discovery_signature(const DiscoveryConfig *config);
+void project_key(const char *relative, const char *directory, char *key, size_t len);
+int is_listed(char **list, int count, const char *name);
+void path_set_add(PathSet *set, const char *path);
+int path_set_contains(const PathSet *set, const char *path);
+void discovery_push(DiscoveryWalk *walk, char *path, int root_len, const DirRecord *cached);
+void discovery_record(DiscoveryWalk *walk, const DiscoveryItem *item, struct timespec mtime, int is_project);
+void discovery_scan(DiscoveryWalk *walk, const DiscoveryItem *item);
+void *discovery_worker(void *arg);
+int discovery_walk(const DiscoveryConfig *config, const DirRecord *cached, int cached_count, DirRecord **records);
+int project_entries_from_records(DirRecord *records, int count, ProjectEntry **entries);
+int compare_project_entries(const void *a, const void *b);
+void free_project_entries(ProjectEntry *entries, int count);
+void free_dir_records(DirRecord *records, int count);
+int xdg_file_path(const char *variable, const char *fallback, const char *name, char *buf, size_t len);
+int cache_file_path(const char *name, char *buf, size_t len);
+int state_file_path(const char *name, char *buf, size_t len);
+int discovery_cache_load(const DiscoveryConfig *config, DirRecord **records);
+void discovery_cache_save(const DiscoveryConfig *config, const DirRecord *records, int count);
 void create_project_entry_screens(int entry_index);
 int screen_exists(const char *name);
+pid_t spawn_start(char *const argv[], const char *cwd, char *const envp[], int *out_fd, int *err_fd, int interactive);
+int spawn_finish(int status, int err_fd, SpawnResult *result);
+int spawn_command(char *const argv[], int interactive, SpawnResult *result);
+int start_job(Job *job);
+void run_jobs(Job *jobs, int count);
+Operation *op_new(const char *label, int job_count, void (*complete)(Operation *op));
+void op_submit(Operation *op);
+void op_wait(Operation *op);
+void op_free(Operation *op);
+void ops_init();
+void ops_schedule();
+int ops_release(Operation *op);
+void ops_advance();
+void ops_probe();
+int ready_connect(Job *job, int family);
+int ready_check(Job *job);
+int ready_check_log(Job *job);
+void launch_plan(const Project *project, Job *jobs);
+int ops_poll_fds(struct pollfd *fds, int max);
+int ops_timeout();
+int ops_process();
+int ops_active();
+void ops_cancel();
+void draw_operations(int height);
+void sigchld_handler(int sig);
+void job_finish(Operation *op, Job *job, int status);
+void job_ended(Operation *op, Job *job);
+Operation *job_operation(const Job *job);
+void kill_complete(Operation *op);
+void kill_one_complete(Operation *op);
+void create_complete(Operation *op);
+void launch_complete(Operation *op);
+void *discovery_thread(void *arg);
+void discovery_start(int full);
+void discovery_finish();
+const char *job_state_label(int state);
+void toggle_mark(int index);
+void mark_screens(int detached_only, const char *pattern);
+void clear_marks();
+void kill_marked_screens();
+void handle_pattern_input(int ch);
+int filter_matches(const char *name, int len);
+int filter_evaluate(const char *name);
+void view_rebuild();
+int view_rows();
+int view_screen(int row);
+void filter_push(int ch);
+void filter_pop();
+void filter_toggle_fuzzy();
+void filter_clear();
+int handle_filter_input(int ch);
+void draw_filter_prompt();
+void draw_filtered_name(const char *name, int width);
+int compare_view_rows(const void *a, const void *b);
+void view_keep_selection(int index);
+int read_proc_stat(pid_t pid, ProcEntry *entry);
+int compare_proc_entries(const void *a, const void *b);
+int proc_owner(int e);
+void proc_scan();
+int proc_scan_due();
+void format_kb(unsigned long kb, char *buf, size_t len);
+void cycle_sort();
+WindowCache *window_cache_find(pid_t pid);
+void window_cache_drop(int i);
+int screen_direct_enabled();
+int screen_msg_send(const char *id, int type, const char *window, char *const args[], const char *writeback);
+int screen_conn_open(pid_t pid, const char *path, int *is_fifo);
+void screen_conn_drop(pid_t pid);
+int screen_write_all(int fd, const void *buf, size_t len);
+int screen_job_direct(Job *job);
+int screen_query_send(WindowCache *cache, const char *id, const char *window, char *const args[]);
+void screen_query_path(const WindowCache *cache, char *buf, size_t len);
+void screen_query_close(WindowCache *cache);
+void screen_query_cleanup();
+int window_query_read(WindowCache *cache);
+int window_query_start(WindowCache *cache, const char *id);
+void window_query_finish(WindowCache *cache, int state);
+void windows_prefetch();
+int windows_poll_fds(struct pollfd *fds, int max);
+int windows_timeout();
+int windows_process();
+void windows_parse(WindowCache *cache);
+ssize_t proc_read(pid_t pid, const char *file, char *buf, size_t len);
+int proc_environ_value(pid_t pid, const char *key, char *value, size_t len);
+int proc_window_number(pid_t pid);
+void window_commands_resolve(WindowCache *cache);
+void draw_window_pane(int top, int height);
 void set_status(const char *message, int type);
 void handle_input(int ch);
+double monotonic_us();
+void stat_record(int id, double start_us);
+double stat_percentile(const Stat *stat, double percentile);
+int compare_doubles(const void *a, const void *b);
+void draw_stats_menu(WINDOW *win);
+void stats_dump();
+int screen_lookup(const char *key);
+int cli_main(int argc, char *argv[]);
+int cli_list(int argc, char *argv[]);
+int cli_create(int argc, char *argv[]);
+int cli_kill(int argc, char *argv[]);
+int cli_project(int argc, char *argv[]);
+int cli_send(int argc, char *argv[]);
+int cli_snapshot(int argc, char *argv[]);
+int cli_restore(int argc, char *argv[]);
+int is_shell(const char *argv0);
+void fput_word(FILE *fp, const char *word);
+void fput_field(FILE *fp, const char *text);
+void unescape_field(char *text);
+int compare_snapshot_windows(const void *a, const void *b);
+char *snapshot_command(const ProcEntry *entry);
+int snapshot_windows(pid_t server, SnapshotWindow **windows, int *capacity);
+void free_snapshot_sessions(SnapshotSession *sessions, int count);
+int snapshot_write(FILE *fp);
+int snapshot_read(FILE *fp, SnapshotSession **sessions);
+char *restore_script(const SnapshotSession *session);
+void restore_job_init(Job *job, const SnapshotSession *session);
+void cli_usage(FILE *fp);
+void json_string(FILE *fp, const char *str);
+int cli_fetch_screens();
+int daemon_socket_path(struct sockaddr_un *addr);
+int daemon_connect();
+int daemon_listen();
+int daemon_main();
+void daemon_handle_request(DaemonClient *client, char *line);
+void daemon_reply(DaemonClient *client, const char *format, ...);
+void daemon_reply_screen(DaemonClient *client, int i);
+void daemon_on_signal(int sig);
 
-/* Main function */
-int main() {
+/* Main function (left out when scream.c is built into the benchmark suite) */
+#ifndef SCREAM_NO_MAIN
+int main(int argc, char *argv[]) {
     int ch;
     
+    /* Concurrency limit for batch operations */
+    if (getenv("SCREAM_JOBS") != NULL && atoi(getenv("SCREAM_JOBS")) > 0) {
+        max_jobs = atoi(getenv("SCREAM_JOBS"));
+    }
+    
+    /* Session backend */
+    if (backend_select(getenv("SCREAM_BACKEND")) != 0) {
+        fprintf(stderr, "scream: unknown backend '%s' (expected screen or tmux)\n", getenv("SCREAM_BACKEND"));
+        return EXIT_USAGE;
+    }
+    
+    /* Only sessions launched from a template carry one; ours must not leak into others */
+    unsetenv("SCREAM_TEMPLATE");
+    
+    /* Timing summary for offline analysis */
+    if (getenv("SCREAM_STATS_FILE") != NULL) {
+        atexit(stats_dump);
+    }
+    
+    /* Resident mode serving the session table over a Unix socket */
+    if (argc > 1 && (strcmp(argv[1], "--daemon") == 0 || strcmp(argv[1], "daemon") == 0)) {
+        return daemon_main();
+    }
+    
+    /* Subcommands run in batch mode without touching the terminal */
+    if (argc > 1) {
+        return cli_main(argc, argv);
+    }
+    
     /* Initialize ncurses */
     initscr();
     cbreak();
@@ -128,40 +954,138 @@ int main() {
     /* Load project templates */
     load_projects();
     
-    /* Get initial list of screens */
-    fetch_screens();
-    
     /* Initialize project entries */
     project_entry_count = 0;
     
+    /* Get initial list of screens, watching the socket directory so it stays live */
+    watch_init();
+    if (watch_fd < 0) {
+        fetch_screens();
+    }
+    
+    /* Create, kill, launch and discovery run in the background from here on */
+    ops_blocking = 0;
+    
+    /* Non-blocking input: stdin and the watch are multiplexed with poll() */
+    nodelay(stdscr, TRUE);
+    draw_current_menu();
+    
     /* Main loop */
     while (1) {
-        switch (current_menu) {
-            case MENU_MAIN:
-                draw_menu(stdscr);
-                break;
-            case MENU_BROWSE:
-                draw_screens(stdscr);
-                break;
-            case MENU_CREATE:
-                draw_create_menu(stdscr);
-                break;
-            case MENU_KILL:
-                draw_kill_menu(stdscr);
-                break;
-            case MENU_PROJECT:
-                draw_project_menu(stdscr);
-                break;
-            case MENU_HELP:
-                draw_help_menu(stdscr);
-                break;
-            case MENU_PROJECT_LIST:
-                draw_project_list_menu(stdscr);
-                break;
+        struct pollfd fds[MAX_POLL_FDS];
+        int nfds = 1;
+        int redraw = 0;
+        int timeout, due, discovery_fd = -1, log_fd = -1;
+        int watch_polled = watch_fd >= 0;
+        
+        fds[0].fd = STDIN_FILENO;
+        fds[0].events = POLLIN;
+        if (watch_polled) {
+            fds[1].fd = watch_fd;
+            fds[1].events = POLLIN;
+            nfds = 2;
+        }
+        
+        /* Window queries for the rows on screen run alongside the input loop */
+        windows_prefetch();
+        nfds += windows_poll_fds(fds + nfds, MAX_WINDOW_QUERIES);
+        
+        /* The log pane follows its file */
+        if (current_menu == MENU_LOG && log_view.watch_fd >= 0) {
+            log_fd = nfds;
+            fds[nfds].fd = log_view.watch_fd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        
+        /* Background operations: exited children and the discovery thread */
+        if (discovery_task.running) {
+            discovery_fd = nfds;
+            fds[nfds].fd = discovery_task.event_fd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        nfds += ops_poll_fds(fds + nfds, MAX_POLL_FDS - nfds);
+        
+        /* Without a watch, wake up periodically to retry setting one up */
+        timeout = watch_fd >= 0 ? -1 : 2000;
+        due = proc_scan_due();
+        if (due >= 0 && (timeout < 0 || due < timeout)) {
+            timeout = due;
+        }
+        due = windows_timeout();
+        if (due >= 0 && (timeout < 0 || due < timeout)) {
+            timeout = due;
+        }
+        due = ops_timeout();
+        if (due >= 0 && (timeout < 0 || due < timeout)) {
+            timeout = due;
+        }
+        if (poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+            break;
+        }
+        
+        /* Session changes first: with tmux they also carry replies to queued jobs */
+        if (watch_fd < 0) {
+            watch_init();
+            if (watch_fd >= 0) {
+                redraw = 1;
+            }
+        } else if (watch_polled && (fds[1].revents & POLLIN) && watch_process() > 0) {
+            redraw = 1;
+        }
+        
+        if (windows_process() > 0) {
+            needs_full_redraw = 1;
+            redraw = 1;
+        }
+        
+        /* Progress of in-flight operations is redrawn on every wakeup */
+        if (ops_active()) {
+            needs_full_redraw = 1;
+            redraw = 1;
+        }
+        if (ops_process() > 0) {
+            needs_full_redraw = 1;
+            redraw = 1;
+        }
+        if (discovery_fd >= 0 && (fds[discovery_fd].revents & POLLIN)) {
+            discovery_finish();
+            needs_full_redraw = 1;
+            redraw = 1;
+        }
+        if (log_fd >= 0 && (fds[log_fd].revents & POLLIN) && log_process() > 0) {
+            needs_full_redraw = 1;
+            redraw = 1;
+        }
+        if (redraw) {
+            needs_full_redraw = 1;
+        }
+        
+        /* Drain all pending keys (also picks up KEY_RESIZE after SIGWINCH) */
+        while ((ch = getch()) != ERR) {
+            handle_input(ch);
+            redraw = 1;
+        }
+        
+        /* Usage columns of the session list refresh once per tick */
+        if (proc_scan_due() == 0) {
+            proc_scan();
+            needs_full_redraw = 1;
+            redraw = 1;
+        }
+        
+        if (redraw) {
+            draw_current_menu();
         }
         
-        ch = getch();
-        handle_input(ch);
+        /* The cached project list is on screen; now check it against the disk */
+        if (project_revalidate_pending) {
+            project_revalidate_pending = 0;
+            revalidate_project_entries(0);
+            needs_full_redraw = 1;
+            draw_current_menu();
+        }
     }
     
     /* End ncurses mode */
@@ -169,9 +1093,119 @@ int main() {
     
     return 0;
 }
+#endif
+
+/* Draw the screen for the current menu */
+void draw_current_menu() {
+    double start = monotonic_us();
+    
+    switch (current_menu) {
+        case MENU_MAIN:
+            draw_menu(stdscr);
+            break;
+        case MENU_BROWSE:
+            draw_screens(stdscr);
+            break;
+        case MENU_CREATE:
+            draw_create_menu(stdscr);
+            break;
+        case MENU_KILL:
+            draw_kill_menu(stdscr);
+            break;
+        case MENU_PROJECT:
+            draw_project_menu(stdscr);
+            break;
+        case MENU_HELP:
+            draw_help_menu(stdscr);
+            break;
+        case MENU_PROJECT_LIST:
+            draw_project_list_menu(stdscr);
+            break;
+        case MENU_STATS:
+            draw_stats_menu(stdscr);
+            break;
+        case MENU_LOG:
+            draw_log_menu(stdscr);
+            break;
+    }
+    
+    needs_full_redraw = 0;
+    dirty_count = 0;
+    stat_record(STAT_RENDER, start);
+}
+
+/* Number of list rows that fit between the column header and the status line */
+int list_rows() {
+    int rows = LINES - LIST_START_Y - 3;
+    
+    /* The window pane takes the lower half of the browser */
+    if (window_pane && current_menu == MENU_BROWSE) {
+        rows /= 2;
+    }
+    
+    return rows > 1 ? rows : 1;
+}
+
+/* Keep the selection inside the list and the viewport around the selection */
+void list_clamp(int *selected, int *top, int count, int rows) {
+    if (*selected >= count) {
+        *selected = count - 1;
+    }
+    if (*selected < 0) {
+        *selected = 0;
+    }
+    if (*top > *selected) {
+        *top = *selected;
+    }
+    if (*top < *selected - rows + 1) {
+        *top = *selected - rows + 1;
+    }
+    if (*top > count - rows) {
+        *top = count - rows;
+    }
+    if (*top < 0) {
+        *top = 0;
+    }
+}
+
+/* Move the selection by delta rows, repainting only the affected rows if the viewport stays put */
+void list_move(int *selected, int *top, int count, int delta) {
+    int old_selected = *selected;
+    int old_top = *top;
+    
+    if (count == 0) {
+        return;
+    }
+    
+    *selected += delta;
+    list_clamp(selected, top, count, list_rows());
+    
+    if (*top != old_top) {
+        needs_full_redraw = 1;
+    } else if (*selected != old_selected) {
+        mark_dirty_row(old_selected);
+        mark_dirty_row(*selected);
+    }
+}
+
+/* Queue a list row for repainting, falling back to a full redraw when too many are queued */
+void mark_dirty_row(int index) {
+    if (dirty_count == MAX_DIRTY_ROWS) {
+        needs_full_redraw = 1;
+        return;
+    }
+    
+    dirty_rows[dirty_count++] = index;
+}
 
-/* Handle keyboard input based on current menu */
+/* Handle keyboard input based on current menu (navigation returns early with dirty rows marked) */
 void handle_input(int ch) {
+    /* Ctrl-X cancels background work from any menu */
+    if (ch == 24 && ops_active()) {
+        ops_cancel();
+        return;
+    }
+    
     switch (current_menu) {
         case MENU_MAIN:
             switch (ch) {
@@ -179,7 +1213,11 @@ void handle_input(int ch) {
                 case 'b':
                     current_menu = MENU_BROWSE;
                     selected_index = 0;
-                    fetch_screens();
+                    screen_top = 0;
+                    filter_clear();
+                    if (watch_fd < 0) {
+                        fetch_screens();
+                    }
                     break;
                 case '2':
                 case 'c':
@@ -192,12 +1230,18 @@ void handle_input(int ch) {
                 case 'k':
                     current_menu = MENU_KILL;
                     selected_index = 0;
-                    fetch_screens();
+                    screen_top = 0;
+                    filter_clear();
+                    clear_marks();
+                    if (watch_fd < 0) {
+                        fetch_screens();
+                    }
                     break;
                 case '4':
                 case 'p':
                     current_menu = MENU_PROJECT;
                     selected_project = 0;
+                    project_top = 0;
                     break;
                 case '5':
                 case 'h':
@@ -208,8 +1252,13 @@ void handle_input(int ch) {
                 case 'l':
                     current_menu = MENU_PROJECT_LIST;
                     selected_project_entry = 0;
+                    project_entry_top = 0;
                     load_project_entries();
                     break;
+                case '7':
+                case 's':
+                    current_menu = MENU_STATS;
+                    break;
                 case 'q':
                     endwin();
                     exit(EXIT_SUCCESS);
@@ -218,20 +1267,52 @@ void handle_input(int ch) {
             break;
             
         case MENU_BROWSE:
+            if (filter_editing && handle_filter_input(ch)) {
+                break;
+            }
+            
             switch (ch) {
                 case KEY_UP:
-                    if (selected_index > 0) {
-                        selected_index--;
+                    list_move(&selected_index, &screen_top, view_rows(), -1);
+                    return;
+                case KEY_DOWN:
+                    list_move(&selected_index, &screen_top, view_rows(), 1);
+                    return;
+                case KEY_PPAGE:
+                    list_move(&selected_index, &screen_top, view_rows(), -list_rows());
+                    return;
+                case KEY_NPAGE:
+                    list_move(&selected_index, &screen_top, view_rows(), list_rows());
+                    return;
+                case KEY_HOME:
+                    list_move(&selected_index, &screen_top, view_rows(), -view_rows());
+                    return;
+                case KEY_END:
+                    list_move(&selected_index, &screen_top, view_rows(), view_rows());
+                    return;
+                case '\n': /* Enter key */
+                    if (view_rows() > 0) {
+                        activate_screen(view_screen(selected_index));
                     }
                     break;
-                case KEY_DOWN:
-                    if (selected_index < screen_count - 1) {
-                        selected_index++;
+                case '/':
+                    filter_editing = 1;
+                    curs_set(1);
+                    break;
+                case 'o':
+                    cycle_sort();
+                    break;
+                case 'w':
+                    if (backend->has_processes) {
+                        window_pane = !window_pane;
+                    } else {
+                        set_status("The window pane needs the screen backend", COLOR_ERROR);
                     }
                     break;
-                case '\n': /* Enter key */
-                    if (screen_count > 0) {
-                        activate_screen(selected_index);
+                case 'v':
+                    if (view_rows() > 0) {
+                        log_open(screen_name(&screens[view_screen(selected_index)]));
+                        current_menu = MENU_LOG;
                     }
                     break;
                 case 'r':
@@ -270,21 +1351,63 @@ void handle_input(int ch) {
             break;
             
         case MENU_KILL:
+            if (pattern_active) {
+                handle_pattern_input(ch);
+                break;
+            }
+            if (filter_editing && handle_filter_input(ch)) {
+                break;
+            }
+            
             switch (ch) {
                 case KEY_UP:
-                    if (selected_index > 0) {
-                        selected_index--;
-                    }
-                    break;
+                    list_move(&selected_index, &screen_top, view_rows(), -1);
+                    return;
                 case KEY_DOWN:
-                    if (selected_index < screen_count - 1) {
-                        selected_index++;
+                    list_move(&selected_index, &screen_top, view_rows(), 1);
+                    return;
+                case KEY_PPAGE:
+                    list_move(&selected_index, &screen_top, view_rows(), -list_rows());
+                    return;
+                case KEY_NPAGE:
+                    list_move(&selected_index, &screen_top, view_rows(), list_rows());
+                    return;
+                case KEY_HOME:
+                    list_move(&selected_index, &screen_top, view_rows(), -view_rows());
+                    return;
+                case KEY_END:
+                    list_move(&selected_index, &screen_top, view_rows(), view_rows());
+                    return;
+                case ' ':
+                    if (view_rows() > 0) {
+                        toggle_mark(view_screen(selected_index));
+                        list_move(&selected_index, &screen_top, view_rows(), 1);
                     }
+                    break; /* full redraw: the footer shows the marked count */
+                case 'a':
+                    mark_screens(1, NULL);
+                    break;
+                case 'm':
+                    pattern_active = 1;
+                    kill_pattern[0] = '\0';
+                    pattern_pos = 0;
+                    curs_set(1);
+                    break;
+                case 'u':
+                    clear_marks();
+                    break;
+                case '/':
+                    filter_editing = 1;
+                    curs_set(1);
+                    break;
+                case 'o':
+                    cycle_sort();
                     break;
                 case '\n': /* Enter key */
-                    if (screen_count > 0) {
-                        kill_screen(selected_index);
-                        fetch_screens();
+                    if (marked_count > 0) {
+                        kill_marked_screens();
+                    } else if (view_rows() > 0) {
+                        kill_screen(view_screen(selected_index));
                     }
                     break;
                 case 'r':
@@ -311,10 +1434,16 @@ void handle_input(int ch) {
                         selected_project++;
                     }
                     break;
+                case KEY_PPAGE:
+                    selected_project = selected_project > 10 ? selected_project - 10 : 0;
+                    break;
+                case KEY_NPAGE:
+                    selected_project = selected_project + 10 < project_count ? selected_project + 10 : project_count - 1;
+                    break;
                 case '\n': /* Enter key */
                     if (project_count > 0) {
+                        /* Stay here so the per-component results are visible */
                         create_project_screens(selected_project);
-                        current_menu = MENU_MAIN;
                     }
                     break;
                 case 'q':
@@ -336,26 +1465,55 @@ void handle_input(int ch) {
             }
             break;
             
+        case MENU_LOG:
+            handle_log_input(ch);
+            break;
+            
+        case MENU_STATS:
+            switch (ch) {
+                case 'r':
+                    memset(stats, 0, sizeof(stats));
+                    set_status("Statistics reset", COLOR_SUCCESS);
+                    break;
+                case 'q':
+                case KEY_BACKSPACE:
+                case 27: /* ESC key */
+                case '\n': /* Enter key */
+                    current_menu = MENU_MAIN;
+                    break;
+            }
+            break;
+            
         case MENU_PROJECT_LIST:
             switch (ch) {
                 case KEY_UP:
-                    if (selected_project_entry > 0) {
-                        selected_project_entry--;
-                    }
-                    break;
+                    list_move(&selected_project_entry, &project_entry_top, project_entry_count, -1);
+                    return;
                 case KEY_DOWN:
-                    if (selected_project_entry < project_entry_count - 1) {
-                        selected_project_entry++;
-                    }
-                    break;
+                    list_move(&selected_project_entry, &project_entry_top, project_entry_count, 1);
+                    return;
+                case KEY_PPAGE:
+                    list_move(&selected_project_entry, &project_entry_top, project_entry_count, -list_rows());
+                    return;
+                case KEY_NPAGE:
+                    list_move(&selected_project_entry, &project_entry_top, project_entry_count, list_rows());
+                    return;
+                case KEY_HOME:
+                    list_move(&selected_project_entry, &project_entry_top, project_entry_count, -project_entry_count);
+                    return;
+                case KEY_END:
+                    list_move(&selected_project_entry, &project_entry_top, project_entry_count, project_entry_count);
+                    return;
                 case '\n': /* Enter key */
                     if (project_entry_count > 0) {
                         create_project_entry_screens(selected_project_entry);
                     }
                     break;
                 case 'r':
-                    load_project_entries();
-                    set_status("Project list refreshed", COLOR_SUCCESS);
+                    revalidate_project_entries(0);
+                    break;
+                case 'R':
+                    revalidate_project_entries(1);
                     break;
                 case 'q':
                 case KEY_BACKSPACE:
@@ -365,6 +1523,9 @@ void handle_input(int ch) {
             }
             break;
     }
+    
+    /* Anything other than plain navigation repaints the whole frame */
+    needs_full_redraw = 1;
 }
 
 /* Set status message with color */
@@ -374,759 +1535,7511 @@ void set_status(const char *message, int type) {
     status_type = type;
 }
 
-/* Main menu display */
-void draw_menu(WINDOW *win) {
-    int width, height;
-    getmaxyx(win, height, width);
+/* Monotonic clock in microseconds */
+double monotonic_us() {
+    struct timespec ts;
     
-    wclear(win);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Record the time since start_us against a hot path */
+void stat_record(int id, double start_us) {
+    Stat *stat = &stats[id];
+    double elapsed = monotonic_us() - start_us;
     
-    /* Draw header */
-    attron(COLOR_PAIR(COLOR_HEADER));
-    mvprintw(1, 2, "SCREAM - SCREEN MANAGEMENT TOOL");
-    attroff(COLOR_PAIR(COLOR_HEADER));
+    stat->samples[stat->count % STAT_SAMPLES] = elapsed;
+    stat->count++;
+    stat->last_us = elapsed;
+    stat->total_us += elapsed;
+    if (elapsed > stat->max_us) {
+        stat->max_us = elapsed;
+    }
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
     
-    /* Draw menu options */
-    attron(COLOR_PAIR(COLOR_NORMAL));
-    mvprintw(4, 5, "1. Browse Screen Sessions");
-    mvprintw(5, 5, "2. Create New Screen");
-    mvprintw(6, 5, "3. Kill Screen Session");
-    mvprintw(7, 5, "4. Project Templates");
-    mvprintw(8, 5, "5. Help");
-    mvprintw(9, 5, "6. Project List Screens");
-    mvprintw(11, 5, "q. Quit");
-    attroff(COLOR_PAIR(COLOR_NORMAL));
+    return (x > y) - (x < y);
+}
+
+/* Percentile over the retained samples (the last STAT_SAMPLES) */
+double stat_percentile(const Stat *stat, double percentile) {
+    double sorted[STAT_SAMPLES];
+    int n = stat->count < STAT_SAMPLES ? (int)stat->count : STAT_SAMPLES;
+    int rank;
     
-    /* Draw status message if any */
-    if (strlen(status_message) > 0) {
-        attron(COLOR_PAIR(status_type));
-        mvprintw(height - 2, 2, "Status: %s", status_message);
-        attroff(COLOR_PAIR(status_type));
+    if (n == 0) {
+        return 0;
     }
     
-    /* Draw footer */
-    attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(height - 1, 2, "Press number or highlighted letter to select");
-    attroff(COLOR_PAIR(COLOR_HELP));
+    memcpy(sorted, stat->samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    rank = (int)(percentile / 100.0 * n + 0.5) - 1;
     
-    refresh();
+    return sorted[rank < 0 ? 0 : rank >= n ? n - 1 : rank];
 }
 
-/* Fetch screen sessions from screen -list command */
-void fetch_screens() {
+/* Append the counters to $SCREAM_STATS_FILE, one tab-separated line per hot path */
+void stats_dump() {
+    const char *path = getenv("SCREAM_STATS_FILE");
     FILE *fp;
-    char cmd_output[MAX_SCREENS * MAX_LINE_LENGTH] = "";
-    char line[MAX_LINE_LENGTH];
-    
-    /* Clear existing screens */
-    screen_count = 0;
-    
-    /* Execute screen -list and capture output */
-    fp = popen("screen -list", "r");
-    if (fp == NULL) {
-        set_status("Failed to run screen -list", COLOR_ERROR);
-        return;
-    }
-    
-    /* Read all output */
-    while (fgets(line, sizeof(line), fp) != NULL) {
-        strcat(cmd_output, line);
-    }
-    pclose(fp);
+    time_t now = time(NULL);
+    int i;
     
-    /* For debugging - sample data if no screens found */
-    if (strstr(cmd_output, "No Sockets found") != NULL) {
-        set_status("No screen sessions found", COLOR_ERROR);
+    if (path == NULL || *path == '\0' || (fp = fopen(path, "a")) == NULL) {
         return;
     }
     
-    /* Process each line */
-    char *line_start = cmd_output;
-    char *line_end;
-    
-    while ((line_end = strchr(line_start, '\n')) != NULL) {
-        /* Extract the current line */
-        *line_end = '\0';  /* Temporarily replace newline with null terminator */
-        
-        /* Check if this is a screen entry (starts with tab or space and contains a dot) */
-        if ((line_start[0] == '\t' || line_start[0] == ' ') && 
-            strchr(line_start, '.') != NULL && 
-            !strstr(line_start, "Sockets")) {
-            
-            /* Skip leading whitespace */
-            while (*line_start == '\t' || *line_start == ' ')
-                line_start++;
-            
-            /* Find the end of the session ID (before first tab) */
-            char *id_end = strchr(line_start, '\t');
-            if (id_end) {
-                /* Extract the full ID */
-                int id_len = id_end - line_start;
-                strncpy(screens[screen_count].full_id, line_start, id_len);
-                screens[screen_count].full_id[id_len] = '\0';
-                
-                /* Split into PID and NAME */
-                char *dot = strchr(screens[screen_count].full_id, '.');
-                if (dot) {
-                    int pid_len = dot - screens[screen_count].full_id;
-                    strncpy(screens[screen_count].pid, screens[screen_count].full_id, pid_len);
-                    screens[screen_count].pid[pid_len] = '\0';
-                    strcpy(screens[screen_count].name, dot + 1);
-                } else {
-                    strcpy(screens[screen_count].pid, screens[screen_count].full_id);
-                    strcpy(screens[screen_count].name, "unknown");
-                }
-                
-                /* Extract timestamp between first set of parentheses */
-                char *time_start = strchr(id_end, '(');
-                if (time_start) {
-                    time_start++; /* Skip the opening parenthesis */
-                    char *time_end = strchr(time_start, ')');
-                    if (time_end) {
-                        int time_len = time_end - time_start;
-                        strncpy(screens[screen_count].timestamp, time_start, time_len);
-                        screens[screen_count].timestamp[time_len] = '\0';
-                        
-                        /* Extract status from second set of parentheses */
-                        char *status_start = strchr(time_end, '(');
-                        if (status_start) {
-                            status_start++; /* Skip the opening parenthesis */
-                            char *status_end = strchr(status_start, ')');
-                            if (status_end) {
-                                int status_len = status_end - status_start;
-                                strncpy(screens[screen_count].status, status_start, status_len);
-                                screens[screen_count].status[status_len] = '\0';
-                                screens[screen_count].is_attached = (strcmp(screens[screen_count].status, "Attached") == 0);
-                            }
-                        }
-                    }
-                }
-                
-                screen_count++;
-                if (screen_count >= MAX_SCREENS) {
-                    break;
-                }
-            }
-        }
+    fprintf(fp, "# scream %d %ld: path count last_us avg_us p99_us max_us\n", (int)getpid(), (long)now);
+    for (i = 0; i < STAT_COUNT; i++) {
+        const Stat *stat = &stats[i];
         
-        /* Restore newline and move to next line */
-        *line_end = '\n';
-        line_start = line_end + 1;
+        fprintf(fp, "%s\t%lu\t%.1f\t%.1f\t%.1f\t%.1f\n", stat_names[i], stat->count, stat->last_us,
+                stat->count ? stat->total_us / stat->count : 0.0, stat_percentile(stat, 99), stat->max_us);
     }
+    fclose(fp);
 }
 
-/* Screen browser display */
-void draw_screens(WINDOW *win) {
-    int i;
-    int start_y = 4;
+/* Draw the status message line if there is one */
+void draw_status_line(int height) {
+    draw_operations(height);
+    if (strlen(status_message) > 0) {
+        attron(COLOR_PAIR(status_type));
+        mvprintw(height - 2, 2, "Status: %s", status_message);
+        attroff(COLOR_PAIR(status_type));
+    }
+}
+
+/* Main menu display */
+void draw_menu(WINDOW *win) {
     int width, height;
-    
     getmaxyx(win, height, width);
     
-    wclear(win);
+    werase(win);
     
     /* Draw header */
     attron(COLOR_PAIR(COLOR_HEADER));
-    mvprintw(1, 2, "SCREEN BROWSER");
+    mvprintw(1, 2, "SCREAM - SCREEN MANAGEMENT TOOL");
     attroff(COLOR_PAIR(COLOR_HEADER));
     
-    /* Draw help text */
+    /* Draw menu options */
+    attron(COLOR_PAIR(COLOR_NORMAL));
+    mvprintw(4, 5, "1. Browse Screen Sessions");
+    mvprintw(5, 5, "2. Create New Screen");
+    mvprintw(6, 5, "3. Kill Screen Session");
+    mvprintw(7, 5, "4. Project Templates");
+    mvprintw(8, 5, "5. Help");
+    mvprintw(9, 5, "6. Project List Screens");
+    mvprintw(10, 5, "7. Statistics");
+    mvprintw(12, 5, "q. Quit");
+    attroff(COLOR_PAIR(COLOR_NORMAL));
+    
+    draw_status_line(height);
+    
+    /* Draw footer */
     attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(2, 2, "Use UP/DOWN to navigate, Enter to activate, r to refresh, q to go back");
+    mvprintw(height - 1, 2, "Press number or highlighted letter to select");
     attroff(COLOR_PAIR(COLOR_HELP));
     
-    /* Draw header row */
-    mvprintw(start_y - 1, 2, "%-5s %-10s %-20s %-25s %-10s", "#", "PID", "NAME", "TIMESTAMP", "STATUS");
+    refresh();
+}
+
+/* Hash and key comparison for the session indexes */
+unsigned long screen_name_hash(const Screen *screen) {
+    return hash_string(screen_name(screen));
+}
+
+int screen_name_matches(const Screen *screen, const void *key) {
+    return strcmp(screen_name(screen), key) == 0;
+}
+
+unsigned long screen_pid_hash(const Screen *screen) {
+    return hash_pid(screen->pid);
+}
+
+int screen_pid_matches(const Screen *screen, const void *key) {
+    return screen->pid == *(const pid_t *)key;
+}
+
+/* FNV-1a string hash */
+unsigned long hash_string(const char *str) {
+    unsigned long hash = 2166136261UL;
     
-    /* If no screens found */
-    if (screen_count == 0) {
-        attron(COLOR_PAIR(COLOR_ERROR));
-        mvprintw(start_y + 1, 2, "No screen sessions found.");
-        attroff(COLOR_PAIR(COLOR_ERROR));
-    } else {
-        /* Draw screen list */
-        for (i = 0; i < screen_count; i++) {
-            if (i >= height - start_y - 3) {
-                break; /* Don't draw beyond window height */
-            }
-            
-            if (i == selected_index) {
-                attron(COLOR_PAIR(COLOR_SELECTED));
-            } else {
-                attron(COLOR_PAIR(COLOR_NORMAL));
-            }
-            
-            /* Print row data */
-            mvprintw(start_y + i, 2, "%-5d %-10s %-20s %-25s ", 
-                    i + 1, 
-                    screens[i].pid, 
-                    screens[i].name,
-                    screens[i].timestamp);
-            
-            /* Print status with different color */
-            if (screens[i].is_attached) {
-                if (i == selected_index) {
-                    attron(COLOR_PAIR(COLOR_SELECTED));
-                } else {
-                    attron(COLOR_PAIR(COLOR_STATUS_ATTACHED));
-                }
-                printw("%-10s", "Attached");
-            } else {
-                if (i == selected_index) {
-                    attron(COLOR_PAIR(COLOR_SELECTED));
-                } else {
-                    attron(COLOR_PAIR(COLOR_STATUS_DETACHED));
-                }
-                printw("%-10s", "Detached");
-            }
-            
-            if (i == selected_index) {
-                attroff(COLOR_PAIR(COLOR_SELECTED));
-            } else if (screens[i].is_attached) {
-                attroff(COLOR_PAIR(COLOR_STATUS_ATTACHED));
-            } else {
-                attroff(COLOR_PAIR(COLOR_STATUS_DETACHED));
-            }
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619UL;
+    }
+    
+    return hash;
+}
+
+/* Multiplicative hash for PIDs */
+unsigned long hash_pid(pid_t pid) {
+    return (unsigned long)pid * 2654435761UL;
+}
+
+/* Add screens[i] to an index */
+void screen_index_insert(ScreenIndex *index, int i) {
+    size_t slot = index->hash(&screens[i]) & index->mask;
+    
+    while (index->slots[slot] != 0) {
+        slot = (slot + 1) & index->mask;
+    }
+    index->slots[slot] = i + 1;
+}
+
+/* Remove screens[i] from an index, shifting back later entries of the probe run */
+void screen_index_remove(ScreenIndex *index, int i) {
+    size_t slot = index->hash(&screens[i]) & index->mask;
+    size_t next, home;
+    
+    while (index->slots[slot] != i + 1) {
+        if (index->slots[slot] == 0) {
+            return;
         }
+        slot = (slot + 1) & index->mask;
     }
     
-    /* Draw status message if any */
-    if (strlen(status_message) > 0) {
-        attron(COLOR_PAIR(status_type));
-        mvprintw(height - 2, 2, "Status: %s", status_message);
-        attroff(COLOR_PAIR(status_type));
+    next = slot;
+    while (1) {
+        next = (next + 1) & index->mask;
+        if (index->slots[next] == 0) {
+            break;
+        }
+        
+        /* Move the entry back only if that does not skip over its home slot */
+        home = index->hash(&screens[index->slots[next] - 1]) & index->mask;
+        if (((next - home) & index->mask) >= ((next - slot) & index->mask)) {
+            index->slots[slot] = index->slots[next];
+            slot = next;
+        }
     }
+    index->slots[slot] = 0;
+}
+
+/* Repoint the entry for a session that moved from screens[from] to screens[to] */
+void screen_index_move(ScreenIndex *index, int from, int to) {
+    size_t slot = index->hash(&screens[to]) & index->mask;
     
-    /* Draw footer */
-    attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(height - 1, 2, "Found %d screen sessions", screen_count);
-    attroff(COLOR_PAIR(COLOR_HELP));
+    while (index->slots[slot] != 0) {
+        if (index->slots[slot] == from + 1) {
+            index->slots[slot] = to + 1;
+            return;
+        }
+        slot = (slot + 1) & index->mask;
+    }
+}
+
+/* Reallocate an index with nslots slots (a power of two) and re-add every session */
+void screen_index_rebuild(ScreenIndex *index, size_t nslots) {
+    int i;
     
-    refresh();
+    free(index->slots);
+    index->slots = calloc(nslots, sizeof(int));
+    if (index->slots == NULL) {
+        endwin();
+        fprintf(stderr, "scream: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    index->mask = nslots - 1;
+    
+    for (i = 0; i < screen_count; i++) {
+        screen_index_insert(index, i);
+    }
 }
 
-/* Create screen menu display */
-void draw_create_menu(WINDOW *win) {
-    int width, height;
-    getmaxyx(win, height, width);
+/* Look up a session by key and its hash; returns its index in screens[] or -1 */
+int screen_index_find(const ScreenIndex *index, unsigned long hash, const void *key) {
+    size_t slot;
     
-    wclear(win);
+    if (index->slots == NULL) {
+        return -1;
+    }
     
-    /* Draw header */
-    attron(COLOR_PAIR(COLOR_HEADER));
-    mvprintw(1, 2, "CREATE NEW SCREEN");
-    attroff(COLOR_PAIR(COLOR_HEADER));
+    slot = hash & index->mask;
+    while (index->slots[slot] != 0) {
+        if (index->matches(&screens[index->slots[slot] - 1], key)) {
+            return index->slots[slot] - 1;
+        }
+        slot = (slot + 1) & index->mask;
+    }
     
-    /* Draw help text */
-    attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(2, 2, "Enter screen name and press Enter to create, ESC to cancel");
-    attroff(COLOR_PAIR(COLOR_HELP));
+    return -1;
+}
+
+/* Session strings in the shared pool */
+const char *screen_id(const Screen *screen) {
+    return screen_strings + screen->id;
+}
+
+const char *screen_name(const Screen *screen) {
+    return screen_strings + screen->name;
+}
+
+/*
+ * Fill in a session from its unterminated "pid.name" id. The id is appended
+ * to the string pool, which may move it; returns -1 without memory.
+ */
+int screen_init(Screen *screen, const char *id, size_t id_len, time_t created) {
+    const char *dot = memchr(id, '.', id_len);
+    size_t need = id_len + 1 + (dot == NULL ? sizeof("unknown") : 0);
     
-    /* Draw input field */
-    attron(COLOR_PAIR(COLOR_NORMAL));
-    mvprintw(4, 2, "Screen Name: ");
-    mvprintw(4, 15, "%s", new_screen_name);
-    attroff(COLOR_PAIR(COLOR_NORMAL));
+    memset(screen, 0, sizeof(*screen));
+    if (screen_strings_size + need > screen_strings_capacity) {
+        size_t capacity = screen_strings_capacity ? screen_strings_capacity : 4096;
+        char *grown;
+        
+        while (capacity < screen_strings_size + need) {
+            capacity *= 2;
+        }
+        grown = realloc(screen_strings, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        screen_strings = grown;
+        screen_strings_capacity = capacity;
+    }
     
-    /* Position cursor at end of input */
-    move(4, 15 + cursor_pos);
+    screen->id = screen_strings_size;
+    memcpy(screen_strings + screen->id, id, id_len);
+    screen_strings[screen->id + id_len] = '\0';
+    screen_strings_size += need;
     
-    /* Draw status message if any */
-    if (strlen(status_message) > 0) {
-        attron(COLOR_PAIR(status_type));
-        mvprintw(height - 2, 2, "Status: %s", status_message);
-        attroff(COLOR_PAIR(status_type));
+    /* Split into PID and NAME */
+    screen->pid = (pid_t)atol(screen_strings + screen->id);
+    if (dot != NULL) {
+        screen->name = screen->id + (dot - id) + 1;
+    } else {
+        screen->name = screen->id + id_len + 1;
+        strcpy(screen_strings + screen->name, "unknown");
     }
+    screen->created = created;
     
-    refresh();
+    return 0;
 }
 
-/* Kill screen menu display */
-void draw_kill_menu(WINDOW *win) {
-    int i;
-    int start_y = 4;
-    int width, height;
+/* Release a session's strings; the pool space is reclaimed by the next compaction */
+void screen_free(Screen *screen) {
+    size_t id_len = strlen(screen_id(screen));
     
-    getmaxyx(win, height, width);
+    screen_strings_garbage += id_len + 1;
+    if (screen->name > screen->id + id_len) {
+        screen_strings_garbage += sizeof("unknown");
+    }
+}
+
+/* Rewrite the string pool with only the strings of sessions in the table */
+void screen_strings_compact() {
+    size_t capacity = screen_strings_size - screen_strings_garbage + 1;
+    char *pool = malloc(capacity);
+    size_t size = 0;
+    int i;
     
-    wclear(win);
+    if (pool == NULL) {
+        return;
+    }
     
-    /* Draw header */
-    attron(COLOR_PAIR(COLOR_HEADER));
-    mvprintw(1, 2, "KILL SCREEN SESSION");
-    attroff(COLOR_PAIR(COLOR_HEADER));
+    for (i = 0; i < screen_count; i++) {
+        Screen *screen = &screens[i];
+        size_t id_len = strlen(screen_id(screen));
+        size_t need = id_len + 1 + (screen->name > screen->id + id_len ? sizeof("unknown") : 0);
+        
+        memcpy(pool + size, screen_id(screen), need);
+        screen->name = size + (screen->name - screen->id);
+        screen->id = size;
+        size += need;
+    }
     
-    /* Draw help text */
-    attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(2, 2, "Use UP/DOWN to navigate, Enter to kill session, r to refresh, q to go back");
-    attroff(COLOR_PAIR(COLOR_HELP));
+    free(screen_strings);
+    screen_strings = pool;
+    screen_strings_size = size;
+    screen_strings_capacity = capacity;
+    screen_strings_garbage = 0;
+}
+
+/* Session state from the status text of screen -list, e.g. "Multi, attached" */
+int screen_parse_state(const char *text, size_t len) {
+    char status[32];
     
-    /* Draw header row */
-    mvprintw(start_y - 1, 2, "%-5s %-10s %-20s %-25s %-10s", "#", "PID", "NAME", "TIMESTAMP", "STATUS");
+    snprintf(status, sizeof(status), "%.*s", (int)len, text);
+    if (strstr(status, "ead") != NULL || strstr(status, "Unreachable") != NULL) {
+        return SCREEN_DEAD;
+    }
+    if (strstr(status, "ttached") != NULL && strstr(status, "etached") == NULL) {
+        return SCREEN_ATTACHED;
+    }
+    return SCREEN_DETACHED;
+}
+
+/*
+ * Creation time from screen -list's "MM/DD/YYYY HH:MM:SS AM" timestamp (some
+ * builds print a two-digit year and a 24-hour clock); 0 if unrecognized.
+ * mktime() is only called once per distinct hour, the rest is arithmetic.
+ */
+time_t screen_parse_time(const char *text, size_t len) {
+    static struct tm cached_tm;
+    static time_t cached_hour = -1;
+    const char *end = text + len;
+    int field[6];
+    int i;
+    struct tm tm;
     
-    /* If no screens found */
-    if (screen_count == 0) {
-        attron(COLOR_PAIR(COLOR_ERROR));
-        mvprintw(start_y + 1, 2, "No screen sessions found.");
-        attroff(COLOR_PAIR(COLOR_ERROR));
-    } else {
-        /* Draw screen list */
-        for (i = 0; i < screen_count; i++) {
-            if (i >= height - start_y - 3) {
-                break; /* Don't draw beyond window height */
-            }
-            
-            if (i == selected_index) {
-                attron(COLOR_PAIR(COLOR_SELECTED));
-            } else {
-                attron(COLOR_PAIR(COLOR_NORMAL));
-            }
-            
-            mvprintw(start_y + i, 2, "%-5d %-10s %-20s %-25s ", 
-                    i + 1, 
-                    screens[i].pid, 
-                    screens[i].name,
-                    screens[i].timestamp);
-            
-            /* Print status with different color */
-            if (screens[i].is_attached) {
-                if (i == selected_index) {
-                    attron(COLOR_PAIR(COLOR_SELECTED));
-                } else {
-                    attron(COLOR_PAIR(COLOR_STATUS_ATTACHED));
-                }
-                printw("%-10s", "Attached");
-            } else {
-                if (i == selected_index) {
-                    attron(COLOR_PAIR(COLOR_SELECTED));
-                } else {
-                    attron(COLOR_PAIR(COLOR_STATUS_DETACHED));
-                }
-                printw("%-10s", "Detached");
-            }
-            
-            if (i == selected_index) {
-                attroff(COLOR_PAIR(COLOR_SELECTED));
-            } else if (screens[i].is_attached) {
-                attroff(COLOR_PAIR(COLOR_STATUS_ATTACHED));
-            } else {
-                attroff(COLOR_PAIR(COLOR_STATUS_DETACHED));
-            }
+    for (i = 0; i < 6; i++) {
+        if (text == end || !isdigit((unsigned char)*text)) {
+            return 0;
+        }
+        for (field[i] = 0; text < end && isdigit((unsigned char)*text); text++) {
+            field[i] = field[i] * 10 + (*text - '0');
+        }
+        if (i < 5 && (text == end || *text++ != "// ::"[i])) {
+            return 0;
         }
     }
     
-    /* Draw status message if any */
-    if (strlen(status_message) > 0) {
-        attron(COLOR_PAIR(status_type));
-        mvprintw(height - 2, 2, "Status: %s", status_message);
-        attroff(COLOR_PAIR(status_type));
+    if (field[2] < 100) {
+        field[2] += 2000;
+    }
+    while (text < end && *text == ' ') {
+        text++;
+    }
+    if (text < end && (*text == 'P' || *text == 'A')) {
+        field[3] = field[3] % 12 + (*text == 'P' ? 12 : 0);
     }
     
-    /* Draw footer */
-    attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(height - 1, 2, "Found %d screen sessions", screen_count);
-    attroff(COLOR_PAIR(COLOR_HELP));
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_mon = field[0] - 1;
+    tm.tm_mday = field[1];
+    tm.tm_year = field[2] - 1900;
+    tm.tm_hour = field[3];
+    tm.tm_isdst = -1;
     
-    refresh();
+    if (cached_hour == -1 || tm.tm_hour != cached_tm.tm_hour || tm.tm_mday != cached_tm.tm_mday ||
+        tm.tm_mon != cached_tm.tm_mon || tm.tm_year != cached_tm.tm_year) {
+        cached_tm = tm;
+        cached_hour = mktime(&tm);
+        if (cached_hour == -1) {
+            return 0;
+        }
+    }
+    
+    return cached_hour + field[4] * 60 + field[5];
 }
 
-/* Project templates menu display */
-void draw_project_menu(WINDOW *win) {
+/* Format a session's creation time the way screen -list does */
+void screen_format_time(const Screen *screen, char *buf, size_t len) {
+    struct tm tm;
+    
+    if (screen->created == 0 || localtime_r(&screen->created, &tm) == NULL ||
+        strftime(buf, len, "%m/%d/%Y %I:%M:%S %p", &tm) == 0) {
+        buf[0] = '\0';
+    }
+}
+
+/* Append a session to the table, growing it as needed; the table takes over its strings */
+int screen_table_add(const Screen *screen) {
     int i;
-    int start_y = 4;
-    int width, height;
     
-    getmaxyx(win, height, width);
+    if (screen_count == screen_capacity) {
+        int capacity = screen_capacity ? screen_capacity * 2 : 64;
+        Screen *grown = realloc(screens, capacity * sizeof(Screen));
+        
+        if (grown == NULL) {
+            endwin();
+            fprintf(stderr, "scream: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        screens = grown;
+        screen_capacity = capacity;
+    }
     
-    wclear(win);
+    i = screen_count++;
+    screens[i] = *screen;
     
-    /* Draw header */
+    /* Reclaim pool space once dropped strings outweigh live ones */
+    if (screen_strings_garbage > 65536 && screen_strings_garbage * 2 > screen_strings_size) {
+        screen_strings_compact();
+    }
+    
+    /* Keep the indexes at most half full */
+    if (name_index.slots == NULL || (size_t)screen_count * 2 > name_index.mask + 1) {
+        size_t nslots = 128;
+        
+        while (nslots < (size_t)screen_count * 2) {
+            nslots *= 2;
+        }
+        screen_index_rebuild(&name_index, nslots);
+        screen_index_rebuild(&pid_index, nslots);
+    } else {
+        screen_index_insert(&name_index, i);
+        screen_index_insert(&pid_index, i);
+    }
+    
+    if (filter_len > 0) {
+        screens[i].filter_len = filter_evaluate(screen_name(&screens[i]));
+        view_stale = 1;
+    }
+    
+    return i;
+}
+
+/* Remove screens[i], keeping the display order of the remaining sessions */
+void screen_table_remove(int i) {
+    int j;
+    
+    if (screens[i].marked) {
+        marked_count--;
+    }
+
+    screen_index_remove(&name_index, i);
+    screen_free(&screens[i]);
+    screen_index_remove(&pid_index, i);
+    
+    memmove(&screens[i], &screens[i + 1], (screen_count - i - 1) * sizeof(Screen));
+    screen_count--;
+    view_stale = 1;
+    
+    for (j = i; j < screen_count; j++) {
+        screen_index_move(&name_index, j + 1, j);
+        screen_index_move(&pid_index, j + 1, j);
+    }
+    
+    if (selected_index >= screen_count && selected_index > 0) {
+        selected_index = screen_count - 1;
+    }
+}
+
+/* Drop every session, keeping the allocated storage */
+void screen_table_clear() {
+    int i;
+    
+    for (i = 0; i < screen_count; i++) {
+        screen_free(&screens[i]);
+    }
+    screen_count = 0;
+    marked_count = 0;
+    view_stale = 1;
+    screen_strings_size = 0;
+    screen_strings_garbage = 0;
+    
+    if (name_index.slots != NULL) {
+        memset(name_index.slots, 0, (name_index.mask + 1) * sizeof(int));
+        memset(pid_index.slots, 0, (pid_index.mask + 1) * sizeof(int));
+    }
+}
+
+/* O(1) session lookups */
+int screen_find_by_name(const char *name) {
+    return screen_index_find(&name_index, hash_string(name), name);
+}
+
+int screen_find_by_pid(pid_t pid) {
+    return screen_index_find(&pid_index, hash_pid(pid), &pid);
+}
+
+/* Find a session by name, pid or full id; returns -1 if there is none */
+int screen_lookup(const char *key) {
+    char *end;
+    long pid;
+    int found = screen_find_by_name(key);
+    
+    if (found < 0 && isdigit((unsigned char)key[0])) {
+        pid = strtol(key, &end, 10);
+        if (*end == '\0' || *end == '.') {
+            found = screen_find_by_pid((pid_t)pid);
+        }
+        if (found >= 0 && *end == '.' && strcmp(screen_id(&screens[found]), key) != 0) {
+            found = -1;
+        }
+    }
+    
+    return found;
+}
+
+/* Pick the session backend by name; screen when unset */
+int backend_select(const char *name) {
+    if (name == NULL || *name == '\0' || strcmp(name, "screen") == 0) {
+        backend = &screen_backend;
+    } else if (strcmp(name, "tmux") == 0) {
+        backend = &tmux_backend;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Refill the session table from the selected backend */
+void fetch_screens() {
+    double start = monotonic_us();
+    
+    backend->fetch();
+    stat_record(STAT_FETCH, start);
+}
+
+/* Fetch screen sessions, preferring the socket directory over screen -list */
+void screen_backend_fetch() {
+    if (fetch_screens_native() != 0) {
+        fetch_screens_list();
+    }
+}
+
+/* Locate the screen socket directory ($SCREENDIR or the system default) */
+int screen_socket_dir(char *buf, size_t len) {
+    const char *env = getenv("SCREENDIR");
+    const char *candidates[] = { "/run/screen", "/var/run/screen", "/tmp/screens" };
+    const char *user = NULL;
+    struct passwd *pw;
+    struct stat st;
+    size_t i;
+    
+    if (env != NULL && *env != '\0') {
+        snprintf(buf, len, "%s", env);
+        return stat(buf, &st) == 0 && S_ISDIR(st.st_mode) ? 0 : -1;
+    }
+    
+    pw = getpwuid(getuid());
+    if (pw != NULL) {
+        user = pw->pw_name;
+    } else {
+        user = getenv("USER");
+    }
+    if (user == NULL) {
+        return -1;
+    }
+    
+    for (i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        snprintf(buf, len, "%s/S-%s", candidates[i], user);
+        if (stat(buf, &st) == 0 && S_ISDIR(st.st_mode)) {
+            return 0;
+        }
+    }
+    
+    return -1;
+}
+
+/*
+ * Creation time and state of a "PID.NAME" socket entry, without touching
+ * the string pool; returns -1 if it is not a live session.
+ */
+int socket_entry_stat(const char *dir, const char *entry, time_t *created, unsigned char *state) {
+    char path[MAX_PATH_LENGTH];
+    struct stat st;
+    const char *dot;
+    char *end;
+    long pid;
+    
+    dot = strchr(entry, '.');
+    if (dot == NULL || dot == entry) {
+        return -1;
+    }
+    
+    pid = strtol(entry, &end, 10);
+    if (end != dot || pid <= 0) {
+        return -1;
+    }
+    
+    snprintf(path, sizeof(path), "%s/%s", dir, entry);
+    if (stat(path, &st) != 0 || !(S_ISSOCK(st.st_mode) || S_ISFIFO(st.st_mode))) {
+        return -1;
+    }
+    
+    /* Skip sockets left behind by dead servers (what screen -wipe would remove) */
+    if (kill((pid_t)pid, 0) != 0 && errno == ESRCH) {
+        return -1;
+    }
+    
+    /* screen -list reports the socket's mtime as the session's date */
+    *created = st.st_mtime;
+    
+    /* Screen marks attached sessions by setting the owner execute bit */
+    *state = (st.st_mode & S_IXUSR) != 0 ? SCREEN_ATTACHED : SCREEN_DETACHED;
+    
+    return 0;
+}
+
+/* Fill a Screen from a "PID.NAME" socket entry; returns -1 if it is not a live session */
+int parse_socket_entry(const char *dir, const char *entry, Screen *screen) {
+    unsigned char state;
+    time_t created;
+    
+    if (socket_entry_stat(dir, entry, &created, &state) != 0 ||
+        screen_init(screen, entry, strlen(entry), created) != 0) {
+        return -1;
+    }
+    screen->state = state;
+    
+    return 0;
+}
+
+/* Fetch screen sessions by reading the socket directory directly */
+int fetch_screens_native() {
+    char dir[MAX_PATH_LENGTH];
+    DIR *dp;
+    struct dirent *de;
+    
+    if (screen_socket_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    
+    dp = opendir(dir);
+    if (dp == NULL) {
+        return -1;
+    }
+    
+    screen_table_clear();
+    while ((de = readdir(dp)) != NULL) {
+        Screen screen;
+        
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        
+        if (parse_socket_entry(dir, de->d_name, &screen) == 0) {
+            screen_table_add(&screen);
+        }
+    }
+    closedir(dp);
+    
+    if (screen_count == 0) {
+        set_status("No screen sessions found", COLOR_ERROR);
+    }
+    
+    return 0;
+}
+
+/* Whether to speak the session socket protocol; SCREAM_SCREEN_DIRECT=0 always runs screen */
+int screen_direct_enabled() {
+    if (screen_direct < 0) {
+        const char *value = getenv("SCREAM_SCREEN_DIRECT");
+        
+        screen_direct = value == NULL || strcmp(value, "0") != 0;
+    }
+    return screen_direct;
+}
+
+/*
+ * A descriptor to write one message to the session socket at path. A FIFO
+ * stays open in screen_conns for the next message to the same server; a
+ * Unix socket is connected anew each time, since screen closes it after
+ * reading one message. Returns -1 with errno set when nobody listens.
+ */
+int screen_conn_open(pid_t pid, const char *path, int *is_fifo) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int i, fd;
+    
+    for (i = 0; i < screen_conn_count; i++) {
+        if (screen_conns[i].pid == pid) {
+            *is_fifo = 1;
+            return screen_conns[i].fd;
+        }
+    }
+    
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    *is_fifo = S_ISFIFO(st.st_mode);
+    
+    if (*is_fifo) {
+        /* With no server reading, this fails with ENXIO instead of blocking */
+        fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+        if (screen_conn_count == MAX_SCREEN_CONNS) {
+            close(screen_conns[0].fd);
+            memmove(&screen_conns[0], &screen_conns[1], (MAX_SCREEN_CONNS - 1) * sizeof(ScreenConn));
+            screen_conn_count--;
+        }
+        screen_conns[screen_conn_count].pid = pid;
+        screen_conns[screen_conn_count].fd = fd;
+        screen_conn_count++;
+        return fd;
+    }
+    
+    if (!S_ISSOCK(st.st_mode) || strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENOTSOCK;
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int saved = errno;
+        
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/* Close the kept FIFO of a server, if there is one */
+void screen_conn_drop(pid_t pid) {
+    int i;
+    
+    for (i = 0; i < screen_conn_count; i++) {
+        if (screen_conns[i].pid == pid) {
+            close(screen_conns[i].fd);
+            memmove(&screen_conns[i], &screen_conns[i + 1], (screen_conn_count - i - 1) * sizeof(ScreenConn));
+            screen_conn_count--;
+            return;
+        }
+    }
+}
+
+/* Write all of buf to a non-blocking descriptor, waiting up to SCREEN_SEND_TIMEOUT_MS for room */
+int screen_write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    double deadline = monotonic_us() + SCREEN_SEND_TIMEOUT_MS * 1000.0;
+    
+    while (len > 0) {
+        struct pollfd pfd;
+        ssize_t n = write(fd, p, len);
+        double now;
+        
+        if (n > 0) {
+            p += n;
+            len -= n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            return -1;
+        }
+        
+        now = monotonic_us();
+        if (now >= deadline) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        poll(&pfd, 1, (int)((deadline - now) / 1000) + 1);
+    }
+    return 0;
+}
+
+/*
+ * Send a command (screen -X) or query (screen -Q) straight to the server of
+ * session id, optionally preselecting a window (screen -p). A query's reply
+ * goes to the writeback path. Returns -1 with errno set when the message
+ * could not be delivered, so the caller can run screen instead.
+ */
+int screen_msg_send(const char *id, int type, const char *window, char *const args[], const char *writeback) {
+    char dir[MAX_PATH_LENGTH];
+    char path[MAX_PATH_LENGTH + MAX_LINE_LENGTH];
+    ScreenMsg msg;
+    struct passwd *pw = getpwuid(getuid());
+    struct timespec zero = { 0, 0 };
+    sigset_t pipe_set, old_set;
+    pid_t pid = (pid_t)atol(id);
+    char *p = msg.m.command.cmd;
+    int i, fd, is_fifo, attempt, saved, rc = -1;
+    
+    if (!screen_direct_enabled() || screen_socket_dir(dir, sizeof(dir)) != 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, id);
+    
+    memset(&msg, 0, sizeof(msg));
+    msg.protocol_revision = SCREEN_MSG_REVISION;
+    msg.type = type;
+    if (isatty(STDIN_FILENO) && ttyname(STDIN_FILENO) != NULL) {
+        snprintf(msg.m_tty, sizeof(msg.m_tty), "%s", ttyname(STDIN_FILENO));
+    }
+    snprintf(msg.m.command.auser, sizeof(msg.m.command.auser), "%s",
+             pw != NULL ? pw->pw_name : getenv("USER") != NULL ? getenv("USER") : "");
+    for (i = 0; args[i] != NULL; i++) {
+        size_t len = strlen(args[i]) + 1;
+        
+        if (p + len >= msg.m.command.cmd + sizeof(msg.m.command.cmd)) {
+            errno = E2BIG;
+            return -1;
+        }
+        memcpy(p, args[i], len);
+        p += len;
+    }
+    msg.m.command.nargs = i;
+    msg.m.command.apid = getpid();
+    if (window != NULL) {
+        snprintf(msg.m.command.preselect, sizeof(msg.m.command.preselect), "%s", window);
+    }
+    if (writeback != NULL) {
+        snprintf(msg.m.command.writeback, sizeof(msg.m.command.writeback), "%s", writeback);
+    }
+    
+    /* A FIFO whose server has died reports EPIPE; keep that from raising SIGPIPE */
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+    
+    for (attempt = 0; attempt < 2; attempt++) {
+        fd = screen_conn_open(pid, path, &is_fifo);
+        if (fd < 0) {
+            break;
+        }
+        rc = screen_write_all(fd, &msg, sizeof(msg));
+        saved = errno;
+        if (!is_fifo) {
+            close(fd);
+        } else if (rc != 0) {
+            screen_conn_drop(pid);
+        }
+        if (rc == 0 || saved != EPIPE) {
+            break;
+        }
+        
+        /* A kept FIFO may have outlived its server; open the socket afresh once */
+        sigtimedwait(&pipe_set, NULL, &zero);
+        errno = saved;
+    }
+    
+    saved = errno;
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    errno = saved;
+    return rc;
+}
+
+/*
+ * Run a job of the form screen -S id -X command... by sending the command
+ * over the session socket. Returns -1 when it has to run screen after all.
+ */
+int screen_job_direct(Job *job) {
+    if (strcmp(job->argv[0], "screen") != 0 || job->argv[1] == NULL || strcmp(job->argv[1], "-S") != 0 ||
+        job->argv[2] == NULL || job->argv[3] == NULL || strcmp(job->argv[3], "-X") != 0) {
+        return -1;
+    }
+    if (screen_msg_send(job->argv[2], SCREEN_MSG_COMMAND, NULL, job->argv + 4, NULL) != 0) {
+        return -1;
+    }
+    if (job->kind == JOB_KIND_KILL) {
+        screen_conn_drop((pid_t)atol(job->argv[2]));
+    }
+    
+    job->pid = 0;
+    job->pidfd = -1;
+    job->err_fd = -1;
+    job->result.status = 0;
+    job->result.error[0] = '\0';
+    job->state = JOB_RUNNING;
+    job->started = monotonic_us();
+    return 0;
+}
+
+/* Writeback path of a direct query, inside the private query directory */
+void screen_query_path(const WindowCache *cache, char *buf, size_t len) {
+    snprintf(buf, len, "%s/%d", screen_query_dir, (int)cache->pid);
+}
+
+/*
+ * Start a query (screen -Q) over the session socket. The server writes its
+ * reply to a writeback of the same kind as its own socket: a FIFO we hold
+ * open for reading, or a Unix socket it connects to. window_query_read
+ * collects the reply. Returns -1 if the query has to go through screen.
+ */
+int screen_query_send(WindowCache *cache, const char *id, const char *window, char *const args[]) {
+    char dir[MAX_PATH_LENGTH];
+    char path[MAX_PATH_LENGTH + MAX_LINE_LENGTH];
+    char writeback[MAX_PATH_LENGTH];
+    struct sockaddr_un addr;
+    struct stat st;
+    
+    cache->out_fd = -1;
+    cache->err_fd = -1;
+    cache->listen_fd = -1;
+    
+    if (!screen_direct_enabled() || screen_socket_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, id);
+    if (stat(path, &st) != 0 || (!S_ISFIFO(st.st_mode) && !S_ISSOCK(st.st_mode))) {
+        return -1;
+    }
+    
+    if (screen_query_dir[0] == '\0') {
+        const char *base = getenv("XDG_RUNTIME_DIR");
+        
+        if (base == NULL || *base == '\0') {
+            base = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+        }
+        snprintf(screen_query_dir, sizeof(screen_query_dir), "%s/scream-query-XXXXXX", base);
+        if (mkdtemp(screen_query_dir) == NULL) {
+            screen_query_dir[0] = '\0';
+            return -1;
+        }
+        atexit(screen_query_cleanup);
+    }
+    
+    screen_query_path(cache, writeback, sizeof(writeback));
+    unlink(writeback);
+    if (S_ISFIFO(st.st_mode)) {
+        /* Read-only, so the server closing its end reads as the end of the reply */
+        if (mkfifo(writeback, 0600) == 0) {
+            cache->out_fd = open(writeback, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        }
+    } else if (strlen(writeback) < sizeof(addr.sun_path)) {
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, writeback);
+        cache->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (cache->listen_fd >= 0 &&
+            (bind(cache->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(cache->listen_fd, 1) != 0)) {
+            close(cache->listen_fd);
+            cache->listen_fd = -1;
+        }
+    }
+    
+    if ((cache->out_fd < 0 && cache->listen_fd < 0) ||
+        screen_msg_send(id, SCREEN_MSG_QUERY, window, args, writeback) != 0) {
+        screen_query_close(cache);
+        return -1;
+    }
+    
+    /* Writing to a FIFO moves its mtime; take that in so the list is not queried again for it */
+    if (stat(path, &st) == 0) {
+        cache->mtime = st.st_mtim;
+        cache->ctime = st.st_ctim;
+    }
+    cache->query_pid = -1;
+    return 0;
+}
+
+/* Close a direct query's descriptors and remove its writeback */
+void screen_query_close(WindowCache *cache) {
+    char writeback[MAX_PATH_LENGTH];
+    
+    if (cache->out_fd >= 0) {
+        close(cache->out_fd);
+        cache->out_fd = -1;
+    }
+    if (cache->listen_fd >= 0) {
+        close(cache->listen_fd);
+        cache->listen_fd = -1;
+    }
+    screen_query_path(cache, writeback, sizeof(writeback));
+    unlink(writeback);
+}
+
+/* Remove the query directory at exit; finished queries have removed their writebacks */
+void screen_query_cleanup() {
+    DIR *dir = opendir(screen_query_dir);
+    struct dirent *entry;
+    char path[MAX_PATH_LENGTH + 256];
+    
+    if (dir != NULL) {
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] != '.') {
+                snprintf(path, sizeof(path), "%s/%s", screen_query_dir, entry->d_name);
+                unlink(path);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(screen_query_dir);
+}
+
+/* Start watching for session changes; watch_fd stays -1 if that is not possible */
+void watch_init() {
+    backend->watch_init();
+}
+
+/* Apply pending session changes; returns the number of changes */
+int watch_process() {
+    return backend->watch_process();
+}
+
+/* Start watching the socket directory with inotify and load the initial list */
+void screen_watch_init() {
+    if (watch_fd >= 0) {
+        return;
+    }
+    
+    if (screen_socket_dir(watch_dir, sizeof(watch_dir)) != 0) {
+        return;
+    }
+    
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0) {
+        return;
+    }
+    
+    watch_wd = inotify_add_watch(watch_fd, watch_dir,
+                                 IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_FROM |
+                                 IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (watch_wd < 0) {
+        close(watch_fd);
+        watch_fd = -1;
+        return;
+    }
+    
+    /* Anything that changed before the watch existed is picked up here */
+    fetch_screens();
+}
+
+/* Apply pending inotify events to screens[]; returns the number of changes */
+int screen_watch_process() {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    ssize_t len;
+    char *ptr;
+    int changes = 0;
+    double start = monotonic_us();
+    
+    while ((len = read(watch_fd, buf, sizeof(buf))) > 0) {
+        for (ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ev->len) {
+            ev = (const struct inotify_event *)ptr;
+            
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED | IN_Q_OVERFLOW)) {
+                /* Directory went away or events were lost: resync from scratch */
+                if (!(ev->mask & IN_Q_OVERFLOW)) {
+                    close(watch_fd);
+                    watch_fd = -1;
+                }
+                fetch_screens();
+                return changes + 1;
+            }
+            
+            if (ev->len > 0 && ev->name[0] != '.') {
+                changes += screen_apply_socket_event(ev->name);
+            }
+        }
+    }
+    
+    /* Only passes that found something count; the daemon polls this per request */
+    if (changes > 0) {
+        stat_record(STAT_WATCH, start);
+    }
+    
+    return changes;
+}
+
+/* Add, update or remove the session for one socket entry; returns 1 if screens[] changed */
+int screen_apply_socket_event(const char *entry) {
+    Screen updated;
+    unsigned char state;
+    time_t created;
+    char *end;
+    long pid;
+    int found;
+    
+    /* Sessions are keyed by the PID prefix of the socket name */
+    pid = strtol(entry, &end, 10);
+    if (end == entry || *end != '.' || pid <= 0) {
+        return 0;
+    }
+    
+    found = screen_find_by_pid((pid_t)pid);
+    if (found >= 0 && strcmp(screen_id(&screens[found]), entry) != 0) {
+        found = -1;
+    }
+    
+    if (found < 0) {
+        if (parse_socket_entry(watch_dir, entry, &updated) != 0) {
+            return 0;
+        }
+        screen_table_add(&updated);
+        return 1;
+    }
+    
+    /* Attach and detach: same socket name, so the strings and index keys are unchanged */
+    if (socket_entry_stat(watch_dir, entry, &created, &state) == 0) {
+        if (screens[found].state == state && screens[found].created == created) {
+            return 0;
+        }
+        screens[found].state = state;
+        screens[found].created = created;
+        return 1;
+    }
+    
+    /* Socket is gone: drop the session */
+    screen_table_remove(found);
+    return 1;
+}
+
+/*
+ * tmux backend. One `tmux -C` control-mode client stays connected for the
+ * life of the program: commands are written to its stdin and their output
+ * arrives between %begin and %end (or %error) lines on its stdout, in the
+ * order they were sent. Notifications such as %sessions-changed arrive
+ * between replies and trigger a list-sessions over the same connection, so
+ * neither listing nor creating and killing sessions forks a process.
+ *
+ * A control client has to be attached to a session, so each scream creates
+ * TMUX_CONTROL_SESSION-<pid> for itself. These are left out of the list,
+ * killed at exit, and cleaned up by the next scream if one was left behind.
+ */
+int tmux_connect() {
+    static double last_attempt = 0;
+    static int registered = 0;
+    char session[MAX_NAME_LENGTH];
+    char *argv[] = { "tmux", "-C", "new-session", "-A", "-s", session, "cat", NULL };
+    posix_spawn_file_actions_t actions;
+    int in[2], out[2];
+    double now = monotonic_us();
+    int rc;
+    
+    if (watch_fd >= 0) {
+        return 0;
+    }
+    
+    /* A missing or failing tmux is retried every 2 seconds at most */
+    if (last_attempt > 0 && now - last_attempt < 2e6) {
+        return -1;
+    }
+    last_attempt = now;
+    snprintf(session, sizeof(session), "%s-%d", TMUX_CONTROL_SESSION, (int)getpid());
+    
+    if (pipe2(in, O_CLOEXEC) != 0) {
+        return -1;
+    }
+    if (pipe2(out, O_CLOEXEC) != 0) {
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    rc = posix_spawnp(&tmux_pid, "tmux", &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(in[0]);
+    close(out[1]);
+    if (rc != 0) {
+        close(in[1]);
+        close(out[0]);
+        tmux_pid = 0;
+        return -1;
+    }
+    
+    fcntl(out[0], F_SETFL, O_NONBLOCK);
+    watch_fd = out[0];
+    tmux_in = in[1];
+    tmux_block = 0;
+    tmux_input_len = 0;
+    
+    if (!registered) {
+        atexit(tmux_close);
+        registered = 1;
+    }
+    tmux_request_list();
+    return 0;
+}
+
+/* At exit: kill this scream's control session, which also ends the client */
+void tmux_close() {
+    if (tmux_in < 0) {
+        return;
+    }
+    tmux_send("kill-session", TMUX_REPLY_IGNORE, NULL);
+    close(tmux_in);
+    tmux_in = -1;
+    if (tmux_pid > 0) {
+        waitpid(tmux_pid, NULL, 0);
+        tmux_pid = 0;
+    }
+}
+
+/* The connection is gone: fail whatever was waiting on it and reap the client */
+void tmux_disconnect() {
+    int i;
+    
+    close(watch_fd);
+    close(tmux_in);
+    watch_fd = -1;
+    tmux_in = -1;
+    if (tmux_pid > 0) {
+        kill(tmux_pid, SIGTERM);
+        waitpid(tmux_pid, NULL, 0);
+        tmux_pid = 0;
+    }
+    
+    for (i = 0; i < tmux_reply_count; i++) {
+        Job *job = tmux_replies[i].job;
+        Operation *op = job != NULL ? job_operation(job) : NULL;
+        
+        if (op != NULL) {
+            job->result.status = -1;
+            snprintf(job->result.error, sizeof(job->result.error), "lost the connection to tmux");
+            job_ended(op, job);
+        }
+    }
+    tmux_reply_count = 0;
+    tmux_list_pending = 0;
+    tmux_list_again = 0;
+    tmux_lists_done++;
+}
+
+/* Send one command line; the reply is handled according to kind */
+int tmux_send(const char *command, int kind, Job *job) {
+    size_t len = strlen(command), sent = 0;
+    
+    if (tmux_in < 0) {
+        return -1;
+    }
+    
+    while (sent <= len) {
+        ssize_t n = sent < len ? write(tmux_in, command + sent, len - sent) : write(tmux_in, "\n", 1);
+        
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        sent += n;
+    }
+    
+    tmux_replies = grow_array(tmux_replies, &tmux_reply_capacity, tmux_reply_count, sizeof(TmuxReply));
+    tmux_replies[tmux_reply_count].kind = kind;
+    tmux_replies[tmux_reply_count].job = job;
+    tmux_reply_count++;
+    return 0;
+}
+
+/* Ask for the session list, at most one request in flight plus one queued behind it */
+void tmux_request_list() {
+    if (tmux_list_pending) {
+        tmux_list_again = 1;
+        return;
+    }
+    if (tmux_send("list-sessions -F '#{session_id} #{session_created} #{session_attached} #{session_name}'",
+                  TMUX_REPLY_LIST, NULL) == 0) {
+        tmux_list_pending = 1;
+    }
+}
+
+/* Append a string to a command in tmux single quotes */
+void tmux_quote(char *buf, size_t len, const char *text) {
+    size_t used = strlen(buf);
+    
+    if (used + 3 > len) {
+        return;
+    }
+    buf[used++] = '\'';
+    for (; *text != '\0' && used + 6 < len; text++) {
+        if (*text == '\'') {
+            memcpy(buf + used, "'\\''", 4);
+            used += 4;
+        } else if (*text != '\n') {
+            buf[used++] = *text;
+        }
+    }
+    buf[used++] = '\'';
+    buf[used] = '\0';
+}
+
+/*
+ * Bring the table in line with list-sessions output ("$id created attached
+ * name" per line). Sessions are keyed by their tmux id, which stands in for
+ * the PID: a session's id is "N.name" for tmux session $N.
+ */
+int tmux_apply_list(char *output) {
+    char *line, *end;
+    pid_t *seen = NULL;
+    int seen_count = 0, seen_capacity = 0;
+    int i, j, changes = 0;
+    
+    for (line = output; *line != '\0'; line = end) {
+        char id[MAX_LINE_LENGTH];
+        long number, created, attached;
+        int offset, len, found;
+        Screen screen;
+        
+        end = strchr(line, '\n');
+        end = end != NULL ? end + 1 : line + strlen(line);
+        if (sscanf(line, "$%ld %ld %ld %n", &number, &created, &attached, &offset) != 3) {
+            continue;
+        }
+        len = (int)strcspn(line + offset, "\n");
+        
+        /* Control sessions are not listed; those left behind by a scream that died are killed */
+        if (strncmp(line + offset, TMUX_CONTROL_SESSION "-", sizeof(TMUX_CONTROL_SESSION)) == 0) {
+            long owner = atol(line + offset + sizeof(TMUX_CONTROL_SESSION));
+            
+            if (owner > 0 && kill((pid_t)owner, 0) != 0 && errno == ESRCH) {
+                snprintf(id, sizeof(id), "kill-session -t '$%ld'", number);
+                tmux_send(id, TMUX_REPLY_IGNORE, NULL);
+            }
+            continue;
+        }
+        
+        len = snprintf(id, sizeof(id), "%ld.%.*s", number, len, line + offset);
+        if (len >= (int)sizeof(id) || screen_init(&screen, id, len, (time_t)created) != 0) {
+            continue;
+        }
+        screen.state = attached > 0 ? SCREEN_ATTACHED : SCREEN_DETACHED;
+        seen = grow_array(seen, &seen_capacity, seen_count, sizeof(pid_t));
+        seen[seen_count++] = screen.pid;
+        
+        found = screen_find_by_pid(screen.pid);
+        if (found >= 0 && strcmp(screen_id(&screens[found]), id) != 0) {
+            /* Renamed: the name index needs the new string */
+            screen_table_remove(found);
+            found = -1;
+        }
+        if (found < 0) {
+            screen_table_add(&screen);
+            changes++;
+        } else {
+            screen_free(&screen);
+            if (screens[found].state != screen.state) {
+                screens[found].state = screen.state;
+                changes++;
+            }
+        }
+    }
+    
+    for (i = screen_count - 1; i >= 0; i--) {
+        for (j = 0; j < seen_count && seen[j] != screens[i].pid; j++) {
+        }
+        if (j == seen_count) {
+            screen_table_remove(i);
+            changes++;
+        }
+    }
+    free(seen);
+    
+    if (changes > 0) {
+        view_stale = 1;
+    }
+    return changes;
+}
+
+/* Handle one line from the control connection; returns the number of table changes */
+int tmux_line(char *line) {
+    int changes = 0;
+    
+    if (tmux_block != 0) {
+        if (strncmp(line, "%end ", 5) != 0 && strncmp(line, "%error ", 7) != 0) {
+            int len = (int)strlen(line);
+            
+            if (tmux_block == 1) {
+                tmux_output = grow_array(tmux_output, &tmux_output_capacity, tmux_output_len + len + 1, 1);
+                memcpy(tmux_output + tmux_output_len, line, len);
+                tmux_output_len += len;
+                tmux_output[tmux_output_len++] = '\n';
+            }
+            return 0;
+        }
+        
+        if (tmux_block == 1 && tmux_reply_count > 0) {
+            TmuxReply reply = tmux_replies[0];
+            int error = line[1] == 'e' && line[2] == 'r';
+            
+            memmove(tmux_replies, tmux_replies + 1, (tmux_reply_count - 1) * sizeof(TmuxReply));
+            tmux_reply_count--;
+            tmux_output = grow_array(tmux_output, &tmux_output_capacity, tmux_output_len + 1, 1);
+            tmux_output[tmux_output_len] = '\0';
+            
+            if (reply.kind == TMUX_REPLY_LIST) {
+                if (!error) {
+                    changes = tmux_apply_list(tmux_output);
+                }
+                tmux_list_pending = 0;
+                tmux_lists_done++;
+                if (tmux_list_again) {
+                    tmux_list_again = 0;
+                    tmux_request_list();
+                }
+            } else if (reply.kind == TMUX_REPLY_JOB && job_operation(reply.job) != NULL) {
+                reply.job->result.status = error ? 1 : 0;
+                snprintf(reply.job->result.error, sizeof(reply.job->result.error), "%.*s",
+                         error ? (int)strcspn(tmux_output, "\n") : 0, tmux_output);
+                job_ended(job_operation(reply.job), reply.job);
+            }
+        }
+        tmux_block = 0;
+        return changes;
+    }
+    
+    if (strncmp(line, "%begin ", 7) == 0) {
+        unsigned long time, number, flags = 0;
+        
+        /* Flag 1 marks the reply to a command this client sent */
+        sscanf(line + 7, "%lu %lu %lu", &time, &number, &flags);
+        tmux_block = flags & 1 ? 1 : 2;
+        tmux_output_len = 0;
+    } else if (strcmp(line, "%sessions-changed") == 0 || strncmp(line, "%session-renamed ", 17) == 0 ||
+               strncmp(line, "%client-session-changed ", 24) == 0 || strncmp(line, "%client-detached ", 17) == 0) {
+        tmux_request_list();
+    }
+    
+    return 0;
+}
+
+/* Read what the control connection has sent; returns the number of table changes */
+int tmux_process() {
+    int changes = 0;
+    double start = monotonic_us();
+    
+    if (watch_fd < 0) {
+        return 0;
+    }
+    
+    while (1) {
+        ssize_t n;
+        char *line, *end;
+        
+        tmux_input = grow_array(tmux_input, &tmux_input_capacity, tmux_input_len + 4096, 1);
+        n = read(watch_fd, tmux_input + tmux_input_len, tmux_input_capacity - tmux_input_len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0 || errno != EAGAIN) {
+                tmux_disconnect();
+                return changes + 1;
+            }
+            break;
+        }
+        tmux_input_len += n;
+        
+        for (line = tmux_input; (end = memchr(line, '\n', tmux_input + tmux_input_len - line)) != NULL; line = end + 1) {
+            *end = '\0';
+            changes += tmux_line(line);
+        }
+        tmux_input_len -= line - tmux_input;
+        memmove(tmux_input, line, tmux_input_len);
+    }
+    
+    if (changes > 0) {
+        stat_record(STAT_WATCH, start);
+    }
+    return changes;
+}
+
+/* Fetch the list over the control connection and wait for the reply */
+void tmux_fetch() {
+    unsigned long target;
+    double deadline = monotonic_us() + TMUX_REPLY_TIMEOUT_MS * 1000.0;
+    
+    if (tmux_connect() != 0) {
+        set_status("Cannot connect to tmux", COLOR_ERROR);
+        return;
+    }
+    
+    /* A list already in flight may predate the caller's change, so wait for a fresh one */
+    target = tmux_lists_done + (tmux_list_pending ? 2 : 1);
+    tmux_request_list();
+    
+    while (watch_fd >= 0 && tmux_lists_done < target) {
+        struct pollfd pfd = { watch_fd, POLLIN, 0 };
+        double now = monotonic_us();
+        
+        if (now >= deadline) {
+            set_status("tmux did not answer", COLOR_ERROR);
+            break;
+        }
+        if (poll(&pfd, 1, (int)((deadline - now) / 1000) + 1) > 0) {
+            tmux_process();
+        }
+    }
+}
+
+void tmux_watch_init() {
+    tmux_connect();
+}
+
+int tmux_watch_process() {
+    return tmux_process();
+}
+
+/* Send a job's new-session or kill-session; the reply settles it in tmux_line */
+int tmux_start_job(Job *job) {
+    char command[MAX_PATH_LENGTH * 2];
+    int i;
+    
+    if (tmux_connect() != 0) {
+        snprintf(job->result.error, sizeof(job->result.error), "cannot connect to tmux");
+        return -1;
+    }
+    
+    if (job->kind == JOB_KIND_KILL) {
+        snprintf(command, sizeof(command), "kill-session -t '$%ld'", atol(job->target));
+    } else {
+        snprintf(command, sizeof(command), "new-session -d -s ");
+        tmux_quote(command, sizeof(command), job->target);
+        if (job->cwd != NULL) {
+            strncat(command, " -c ", sizeof(command) - strlen(command) - 1);
+            tmux_quote(command, sizeof(command), job->cwd);
+        }
+        for (i = 0; job->component != NULL && i < job->component->env_count; i++) {
+            strncat(command, " -e ", sizeof(command) - strlen(command) - 1);
+            tmux_quote(command, sizeof(command), job->component->env[i]);
+        }
+        if (job->script != NULL) {
+            strncat(command, " ", sizeof(command) - strlen(command) - 1);
+            tmux_quote(command, sizeof(command), job->script);
+        }
+    }
+    
+    if (tmux_send(command, TMUX_REPLY_JOB, job) != 0) {
+        snprintf(job->result.error, sizeof(job->result.error), "cannot write to tmux: %s", strerror(errno));
+        return -1;
+    }
+    
+    /* tmux has no log option of its own; the new pane's output is piped to the log */
+    if (job->kind == JOB_KIND_CREATE && job->logfile != NULL) {
+        char shell[MAX_PATH_LENGTH + 32] = "exec cat >> ";
+        char target[MAX_LINE_LENGTH + 8];
+        
+        tmux_quote(shell, sizeof(shell), job->logfile);
+        snprintf(target, sizeof(target), "=%s:", job->target);
+        snprintf(command, sizeof(command), "pipe-pane -o -t ");
+        tmux_quote(command, sizeof(command), target);
+        strncat(command, " ", sizeof(command) - strlen(command) - 1);
+        tmux_quote(command, sizeof(command), shell);
+        tmux_send(command, TMUX_REPLY_IGNORE, NULL);
+    }
+    
+    job->pid = 0;
+    job->pidfd = -1;
+    job->state = JOB_RUNNING;
+    job->started = monotonic_us();
+    return 0;
+}
+
+/* Attach in the foreground, or switch the current client when already inside tmux */
+void tmux_attach(const Screen *screen) {
+    char target[32];
+    char *argv[] = { "tmux", getenv("TMUX") != NULL ? "switch-client" : "attach-session", "-t", target, NULL };
+    SpawnResult result;
+    
+    snprintf(target, sizeof(target), "$%d", (int)screen->pid);
+    spawn_command(argv, 1, &result);
+}
+
+/*
+ * Fetch screen sessions by parsing screen -list output (fallback). The pipe is
+ * read in large chunks and each line is parsed in place as soon as it is
+ * complete; only a trailing partial line is carried over to the next read.
+ */
+void fetch_screens_list() {
+    char *argv[] = { "screen", "-list", NULL };
+    char *buf;
+    size_t size = LIST_READ_CHUNK, used = 0;
+    int out_fd, err_fd, status, no_sockets = 0;
+    SpawnResult result;
+    ssize_t n;
+    pid_t pid;
+    
+    /* Clear existing screens */
+    screen_table_clear();
+    
+    buf = malloc(size);
+    pid = buf != NULL ? spawn_start(argv, NULL, NULL, &out_fd, &err_fd, 0) : -1;
+    if (pid < 0) {
+        free(buf);
+        set_status("Failed to run screen -list", COLOR_ERROR);
+        return;
+    }
+    
+    while ((n = read(out_fd, buf + used, size - used)) != 0) {
+        char *line, *end;
+        
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        used += n;
+        
+        for (line = buf; (end = memchr(line, '\n', buf + used - line)) != NULL; line = end + 1) {
+            Screen entry;
+            
+            if (parse_list_line(line, end - line, &entry) == 0) {
+                screen_table_add(&entry);
+            } else if (end - line >= 16 && memcmp(line, "No Sockets found", 16) == 0) {
+                no_sockets = 1;
+            }
+        }
+        
+        /* Carry the partial line over; a line longer than the buffer grows it */
+        used -= line - buf;
+        memmove(buf, line, used);
+        if (used == size) {
+            char *grown = realloc(buf, size * 2);
+            
+            if (grown == NULL) {
+                break;
+            }
+            buf = grown;
+            size *= 2;
+        }
+    }
+    close(out_fd);
+    free(buf);
+    
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    spawn_finish(status, err_fd, &result);
+    
+    if (no_sockets) {
+        set_status("No screen sessions found", COLOR_ERROR);
+    }
+}
+
+/*
+ * Parse one line of screen -list output without modifying it:
+ *   <TAB>pid.name<TAB>(timestamp)<TAB>(status)
+ * Older screens leave out the timestamp. Returns -1 for other lines.
+ */
+int parse_list_line(const char *line, size_t len, Screen *screen) {
+    const char *end = line + len;
+    const char *id, *id_end, *field[2], *field_end[2];
+    int fields = 0;
+    
+    if (len == 0 || (line[0] != '\t' && line[0] != ' ')) {
+        return -1;
+    }
+    
+    /* Skip leading whitespace */
+    while (line < end && (*line == '\t' || *line == ' ')) {
+        line++;
+    }
+    
+    /* The session ID runs up to the first tab and contains a dot */
+    id = line;
+    id_end = memchr(id, '\t', end - id);
+    if (id_end == NULL || memchr(id, '.', id_end - id) == NULL) {
+        return -1;
+    }
+    
+    /* Parenthesized fields after the ID */
+    for (line = id_end; line < end && fields < 2; fields++) {
+        const char *open = memchr(line, '(', end - line);
+        const char *close;
+        
+        if (open == NULL || (close = memchr(open, ')', end - open)) == NULL) {
+            break;
+        }
+        field[fields] = open + 1;
+        field_end[fields] = close;
+        line = close + 1;
+    }
+    if (fields == 0) {
+        return -1;
+    }
+    
+    if (screen_init(screen, id, id_end - id,
+                    fields == 2 ? screen_parse_time(field[0], field_end[0] - field[0]) : 0) != 0) {
+        return -1;
+    }
+    screen->state = screen_parse_state(field[fields - 1], field_end[fields - 1] - field[fields - 1]);
+    
+    return 0;
+}
+
+/* Read ppid, CPU time and RSS from /proc/PID/stat; returns -1 if the process is gone */
+int read_proc_stat(pid_t pid, ProcEntry *entry) {
+    static long page_kb = 0;
+    char path[64];
+    char buf[1024];
+    char *p;
+    ssize_t n;
+    int fd, field;
+    
+    if (page_kb == 0) {
+        page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    }
+    
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    
+    /* The command name may contain spaces and parentheses; fields resume after the last ')' */
+    p = strrchr(buf, ')');
+    if (p == NULL || p[1] == '\0' || p[2] == '\0') {
+        return -1;
+    }
+    
+    memset(entry, 0, sizeof(*entry));
+    entry->pid = pid;
+    entry->owner = -2;
+    p += 3;     /* field 3 is the one-letter state */
+    
+    for (field = 4; field <= 24 && *p != '\0'; field++) {
+        unsigned long long value = strtoull(p + 1, &p, 10);
+        
+        if (field == 4) {
+            entry->ppid = (pid_t)value;
+        } else if (field == 8) {
+            entry->tpgid = (pid_t)value;
+        } else if (field == 14 || field == 15) {
+            entry->ticks += (unsigned int)value;    /* utime, stime */
+        } else if (field == 24) {
+            entry->rss_kb = (unsigned int)(value * page_kb);
+        }
+    }
+    
+    return 0;
+}
+
+int compare_proc_entries(const void *a, const void *b) {
+    return ((const ProcEntry *)a)->pid - ((const ProcEntry *)b)->pid;
+}
+
+/* Session a process belongs to: the nearest ancestor that is a screen server */
+int proc_owner(int e) {
+    ProcEntry *entry = &proc_entries[e];
+    ProcEntry key, *parent;
+    
+    if (entry->owner != -2) {
+        return entry->owner;
+    }
+    
+    entry->owner = screen_find_by_pid(entry->pid);
+    if (entry->owner >= 0 || entry->ppid <= 1) {
+        if (entry->owner < 0) {
+            entry->owner = -1;
+        }
+        return entry->owner;
+    }
+    
+    /* Mark as resolved before recursing so a pid reuse cycle cannot loop */
+    entry->owner = -1;
+    key.pid = entry->ppid;
+    parent = bsearch(&key, proc_entries, proc_count, sizeof(ProcEntry), compare_proc_entries);
+    if (parent != NULL) {
+        proc_entries[e].owner = proc_owner(parent - proc_entries);
+    }
+    
+    return proc_entries[e].owner;
+}
+
+/*
+ * Refresh the usage columns with one sweep over /proc: every process is read
+ * once, attached to the session whose server it descends from, and summed
+ * into that session's RSS, CPU time and process count.
+ */
+void proc_scan() {
+    double start = monotonic_us();
+    double elapsed = proc_last_scan > 0 ? (start - proc_last_scan) / 1e6 : 0;
+    long clock_ticks = sysconf(_SC_CLK_TCK);
+    unsigned int *ticks;
+    DIR *dp;
+    struct dirent *de;
+    int i, selected = -1;
+    
+    if (view_rows() > 0 && selected_index < view_rows()) {
+        selected = view_screen(selected_index);
+    }
+    proc_last_scan = start;
+    
+    dp = opendir("/proc");
+    if (dp == NULL) {
+        return;
+    }
+    proc_count = 0;
+    while ((de = readdir(dp)) != NULL) {
+        char *end;
+        long pid = strtol(de->d_name, &end, 10);
+        
+        if (*end != '\0' || pid <= 0) {
+            continue;
+        }
+        proc_entries = grow_array(proc_entries, &proc_capacity, proc_count, sizeof(ProcEntry));
+        if (read_proc_stat((pid_t)pid, &proc_entries[proc_count]) == 0) {
+            proc_count++;
+        }
+    }
+    closedir(dp);
+    qsort(proc_entries, proc_count, sizeof(ProcEntry), compare_proc_entries);
+    
+    ticks = calloc(screen_count + 1, sizeof(unsigned int));
+    if (ticks == NULL) {
+        return;
+    }
+    for (i = 0; i < screen_count; i++) {
+        screens[i].rss_kb = 0;
+        screens[i].procs = 0;
+    }
+    
+    for (i = 0; i < proc_count; i++) {
+        int owner = proc_owner(i);
+        
+        if (owner >= 0) {
+            ticks[owner] += proc_entries[i].ticks;
+            screens[owner].rss_kb += proc_entries[i].rss_kb;
+            if (proc_entries[i].pid != screens[owner].pid && screens[owner].procs < USHRT_MAX) {
+                screens[owner].procs++;
+            }
+        }
+    }
+    
+    /* CPU% from the change in tree CPU time since the previous sweep */
+    for (i = 0; i < screen_count; i++) {
+        Screen *screen = &screens[i];
+        unsigned int delta = ticks[i] - screen->cpu_ticks;
+        
+        if (screen->usage_seen && elapsed > 0 && ticks[i] >= screen->cpu_ticks) {
+            double tenths = delta * 1000.0 / clock_ticks / elapsed;
+            
+            screen->cpu = tenths < USHRT_MAX ? (unsigned short)tenths : USHRT_MAX;
+        } else {
+            screen->cpu = 0;
+        }
+        screen->cpu_ticks = ticks[i];
+        screen->usage_seen = 1;
+    }
+    free(ticks);
+    
+    /* Foreground jobs of the windows in the pane, as of this sweep */
+    if (window_pane) {
+        for (i = 0; i < window_cache_count; i++) {
+            window_commands_resolve(&window_cache[i]);
+        }
+    }
+    
+    if (list_sort != SORT_NONE) {
+        view_keep_selection(selected);
+    }
+    stat_record(STAT_PROC, start);
+}
+
+/* Milliseconds until the usage columns need a new sweep, -1 when no session list is shown */
+int proc_scan_due() {
+    double elapsed;
+    
+    if ((current_menu != MENU_BROWSE && current_menu != MENU_KILL) || !backend->has_processes) {
+        return -1;
+    }
+    
+    elapsed = (monotonic_us() - proc_last_scan) / 1000;
+    if (proc_last_scan == 0 || elapsed >= PROC_SCAN_INTERVAL_MS) {
+        return 0;
+    }
+    return (int)(PROC_SCAN_INTERVAL_MS - elapsed) + 1;
+}
+
+/* Human-readable size of a kilobyte count */
+void format_kb(unsigned long kb, char *buf, size_t len) {
+    if (kb < 1024) {
+        snprintf(buf, len, "%luK", kb);
+    } else if (kb < 1024 * 1024) {
+        snprintf(buf, len, "%.1fM", kb / 1024.0);
+    } else {
+        snprintf(buf, len, "%.1fG", kb / (1024.0 * 1024.0));
+    }
+}
+
+/* Switch the session list to the next ordering, keeping the cursor on its session */
+void cycle_sort() {
+    char message[MAX_LINE_LENGTH];
+    int selected = view_rows() > 0 ? view_screen(selected_index) : -1;
+    
+    list_sort = (list_sort + 1) % SORT_COUNT;
+    view_keep_selection(selected);
+    
+    if (list_sort == SORT_NONE) {
+        set_status("Sessions in list order", COLOR_SUCCESS);
+    } else {
+        snprintf(message, sizeof(message), "Sessions sorted by %s", sort_names[list_sort]);
+        set_status(message, COLOR_SUCCESS);
+    }
+}
+
+/* Cached window list of the session with this server pid, or NULL */
+WindowCache *window_cache_find(pid_t pid) {
+    int i;
+    
+    for (i = 0; i < window_cache_count; i++) {
+        if (window_cache[i].pid == pid) {
+            return &window_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* Forget a cached window list (it must not have a query running) */
+void window_cache_drop(int i) {
+    free(window_cache[i].output);
+    free(window_cache[i].windows);
+    window_cache[i] = window_cache[--window_cache_count];
+}
+
+/* Ask a session server for its windows without waiting for the answer */
+int window_query_start(WindowCache *cache, const char *id) {
+    char *args[] = { "windows", NULL };
+    char *argv[] = { "screen", "-S", (char *)id, "-Q", "windows", NULL };
+    
+    /* Over the session socket when possible, otherwise through a screen -Q client */
+    if (screen_query_send(cache, id, NULL, args) != 0) {
+        pid_t pid = spawn_start(argv, NULL, NULL, &cache->out_fd, &cache->err_fd, 0);
+        
+        if (pid < 0) {
+            cache->state = WINDOWS_FAILED;
+            return -1;
+        }
+        fcntl(cache->out_fd, F_SETFL, O_NONBLOCK);
+        cache->query_pid = pid;
+    }
+    
+    cache->state = WINDOWS_PENDING;
+    cache->output_len = 0;
+    cache->started = monotonic_us();
+    cache->deadline = cache->started + WINDOW_QUERY_TIMEOUT_MS * 1000.0;
+    window_queries++;
+    return 0;
+}
+
+/* Reap a query's client (killing it on timeout) and settle the cached state */
+void window_query_finish(WindowCache *cache, int state) {
+    SpawnResult result;
+    int status = 0;
+    pid_t reaped;
+    
+    if (cache->query_pid < 0) {
+        screen_query_close(cache);
+        result.status = 0;
+    } else {
+        if (state == WINDOWS_TIMEOUT) {
+            kill(cache->query_pid, SIGKILL);
+        }
+        
+        while ((reaped = waitpid(cache->query_pid, &status, 0)) < 0 && errno == EINTR) {
+        }
+        close(cache->out_fd);
+        spawn_finish(status, cache->err_fd, &result);
+        
+        /* The exit status is lost, so the reply cannot be trusted */
+        if (reaped < 0) {
+            state = WINDOWS_FAILED;
+        }
+    }
+    
+    if (state == WINDOWS_READY && (result.status != 0 || cache->output_len == 0)) {
+        state = WINDOWS_FAILED;
+    }
+    cache->state = state;
+    if (state == WINDOWS_READY) {
+        windows_parse(cache);
+        window_commands_resolve(cache);
+    }
+    cache->query_pid = 0;
+    window_queries--;
+    stat_record(STAT_WINDOWS, cache->started);
+}
+
+/*
+ * Collect what has arrived of a query's reply. A direct query over a Unix
+ * socket first accepts the server's connection to the writeback. Returns 1
+ * at the end of the reply, 0 while more may come and -1 on a read error.
+ */
+int window_query_read(WindowCache *cache) {
+    ssize_t n;
+    
+    if (cache->out_fd < 0) {
+        cache->out_fd = accept4(cache->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cache->out_fd < 0) {
+            return errno == EAGAIN || errno == EINTR ? 0 : -1;
+        }
+    }
+    
+    while (1) {
+        if (cache->output_capacity - cache->output_len < 1024) {
+            cache->output_capacity = cache->output_capacity ? cache->output_capacity * 2 : 4096;
+            cache->output = realloc(cache->output, cache->output_capacity);
+            if (cache->output == NULL) {
+                endwin();
+                fprintf(stderr, "scream: out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        n = read(cache->out_fd, cache->output + cache->output_len, cache->output_capacity - cache->output_len - 1);
+        if (n <= 0) {
+            break;
+        }
+        cache->output_len += n;
+    }
+    
+    if (n == 0) {
+        /* A writeback FIFO reads as ended until the server has opened it */
+        return cache->query_pid < 0 && cache->listen_fd < 0 && cache->output_len == 0 ? 0 : 1;
+    }
+    return errno == EAGAIN || errno == EINTR ? 0 : -1;
+}
+
+/*
+ * While the window pane is open, query every session on screen whose socket
+ * changed since its list was cached, all at once up to MAX_WINDOW_QUERIES.
+ */
+void windows_prefetch() {
+    char dir[MAX_PATH_LENGTH];
+    char path[MAX_PATH_LENGTH + MAX_LINE_LENGTH];
+    int row, i, rows;
+    
+    if (!window_pane || current_menu != MENU_BROWSE || screen_socket_dir(dir, sizeof(dir)) != 0) {
+        return;
+    }
+    
+    /* Drop lists of sessions that are gone */
+    for (i = window_cache_count - 1; i >= 0; i--) {
+        if (window_cache[i].query_pid == 0 && screen_find_by_pid(window_cache[i].pid) < 0) {
+            window_cache_drop(i);
+        }
+    }
+    
+    rows = list_rows();
+    for (row = screen_top; row < view_rows() && row < screen_top + rows; row++) {
+        Screen *screen = &screens[view_screen(row)];
+        WindowCache *cache = window_cache_find(screen->pid);
+        struct stat st;
+        
+        if (cache != NULL && cache->query_pid != 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, screen_id(screen));
+        if (stat(path, &st) != 0) {
+            continue;
+        }
+        if (cache != NULL && cache->mtime.tv_sec == st.st_mtim.tv_sec && cache->mtime.tv_nsec == st.st_mtim.tv_nsec &&
+            cache->ctime.tv_sec == st.st_ctim.tv_sec && cache->ctime.tv_nsec == st.st_ctim.tv_nsec) {
+            continue;
+        }
+        if (window_queries >= MAX_WINDOW_QUERIES) {
+            break;
+        }
+        
+        if (cache == NULL) {
+            window_cache = grow_array(window_cache, &window_cache_capacity, window_cache_count, sizeof(WindowCache));
+            cache = &window_cache[window_cache_count++];
+            memset(cache, 0, sizeof(*cache));
+            cache->pid = screen->pid;
+        }
+        cache->mtime = st.st_mtim;
+        cache->ctime = st.st_ctim;
+        window_query_start(cache, screen_id(screen));
+    }
+}
+
+/* Add the reply descriptors of running queries to a poll set; returns how many */
+int windows_poll_fds(struct pollfd *fds, int max) {
+    int i, n = 0;
+    
+    for (i = 0; i < window_cache_count && n < max; i++) {
+        if (window_cache[i].query_pid != 0) {
+            fds[n].fd = window_cache[i].out_fd >= 0 ? window_cache[i].out_fd : window_cache[i].listen_fd;
+            fds[n].events = POLLIN;
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Milliseconds until the nearest query deadline, -1 when none is running */
+int windows_timeout() {
+    double now = monotonic_us(), nearest = -1;
+    int i;
+    
+    for (i = 0; i < window_cache_count; i++) {
+        if (window_cache[i].query_pid != 0 && (nearest < 0 || window_cache[i].deadline < nearest)) {
+            nearest = window_cache[i].deadline;
+        }
+    }
+    if (nearest < 0) {
+        return -1;
+    }
+    return nearest <= now ? 0 : (int)((nearest - now) / 1000) + 1;
+}
+
+/* Collect query output, finishing queries at EOF or past their deadline; returns how many finished */
+int windows_process() {
+    double now = monotonic_us();
+    int i, rc, finished = 0;
+    
+    for (i = 0; i < window_cache_count; i++) {
+        WindowCache *cache = &window_cache[i];
+        
+        if (cache->query_pid == 0) {
+            continue;
+        }
+        
+        rc = window_query_read(cache);
+        if (rc > 0) {
+            window_query_finish(cache, WINDOWS_READY);
+            finished++;
+        } else if (rc < 0) {
+            window_query_finish(cache, WINDOWS_FAILED);
+            finished++;
+        } else if (now >= cache->deadline) {
+            /* A hung session server must not hold up the list */
+            window_query_finish(cache, WINDOWS_TIMEOUT);
+            finished++;
+        }
+    }
+    
+    return finished;
+}
+
+/*
+ * Split screen -Q windows output into windows. Entries are separated by two
+ * spaces: "0$ bash  1*$ vim  2-$ logs", a number, its flags and the title.
+ */
+void windows_parse(WindowCache *cache) {
+    char *p = cache->output, *end;
+    
+    cache->output[cache->output_len] = '\0';
+    cache->window_count = 0;
+    
+    while (*p != '\0') {
+        WindowInfo *window;
+        char *flags;
+        
+        while (*p == ' ' || *p == '\n') {
+            p++;
+        }
+        if (!isdigit((unsigned char)*p)) {
+            break;
+        }
+        
+        cache->windows = grow_array(cache->windows, &cache->window_capacity, cache->window_count, sizeof(WindowInfo));
+        window = &cache->windows[cache->window_count++];
+        window->number = (int)strtol(p, &flags, 10);
+        
+        for (p = flags; *p != '\0' && *p != ' ' && *p != '\n'; p++) {
+        }
+        snprintf(window->flags, sizeof(window->flags), "%.*s", (int)(p - flags), flags);
+        if (*p == ' ') {
+            p++;
+        }
+        
+        end = strstr(p, "  ");
+        if (end == NULL) {
+            end = p + strcspn(p, "\n");
+        }
+        snprintf(window->title, sizeof(window->title), "%.*s", (int)(end - p), p);
+        p = end;
+    }
+}
+
+/* Read /proc/PID/FILE into buf, NUL-terminated; returns the length read, -1 on failure */
+ssize_t proc_read(pid_t pid, const char *file, char *buf, size_t len) {
+    char path[64];
+    ssize_t n;
+    int fd;
+    
+    snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, file);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+/* A variable from a process's environment; returns -1 if it is not set */
+int proc_environ_value(pid_t pid, const char *key, char *value, size_t len) {
+    char env[16384];
+    size_t key_len = strlen(key);
+    ssize_t n = proc_read(pid, "environ", env, sizeof(env));
+    char *p;
+    
+    for (p = env; n > 0 && p < env + n; p += strlen(p) + 1) {
+        if (strncmp(p, key, key_len) == 0 && p[key_len] == '=') {
+            snprintf(value, len, "%s", p + key_len + 1);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Number of the screen window a process was started in (its WINDOW variable), -1 for none */
+int proc_window_number(pid_t pid) {
+    char value[16];
+    
+    return proc_environ_value(pid, "WINDOW", value, sizeof(value)) == 0 && isdigit((unsigned char)value[0]) ?
+           atoi(value) : -1;
+}
+
+/*
+ * Commands running in a session's cached windows: screen exports WINDOW=N
+ * to the process it starts in each window, and the foreground process
+ * group of that process's terminal is what the window is running now. One
+ * pass over the server's children from the last /proc sweep; the pane
+ * only prints the result.
+ */
+void window_commands_resolve(WindowCache *cache) {
+    int i, w, number;
+    ssize_t n;
+    
+    for (w = 0; w < cache->window_count; w++) {
+        cache->windows[w].command[0] = '\0';
+    }
+    for (i = 0; i < proc_count && cache->window_count > 0; i++) {
+        WindowInfo *window = NULL;
+        pid_t shown;
+        char *p;
+        
+        if (proc_entries[i].ppid != cache->pid || (number = proc_window_number(proc_entries[i].pid)) < 0) {
+            continue;
+        }
+        for (w = 0; w < cache->window_count; w++) {
+            if (cache->windows[w].number == number) {
+                window = &cache->windows[w];
+                break;
+            }
+        }
+        if (window == NULL || window->command[0] != '\0') {
+            continue;
+        }
+        
+        /* Show the foreground job, or the window's own process without a terminal */
+        shown = proc_entries[i].tpgid > 0 ? proc_entries[i].tpgid : proc_entries[i].pid;
+        n = proc_read(shown, "cmdline", window->command, sizeof(window->command));
+        if (n <= 0) {
+            window->command[0] = '\0';
+            continue;
+        }
+        for (p = window->command; p < window->command + n - 1; p++) {
+            if (*p == '\0') {
+                *p = ' ';
+            }
+        }
+    }
+}
+
+/* Windows of the selected session below the browser list */
+void draw_window_pane(int top, int height) {
+    WindowCache *cache = NULL;
+    Screen *screen;
+    int i, shown;
+    
+    if (height < 3 || view_rows() == 0) {
+        return;
+    }
+    screen = &screens[view_screen(selected_index)];
+    cache = window_cache_find(screen->pid);
+    
+    attron(COLOR_PAIR(COLOR_HEADER));
+    mvprintw(top, 2, "Windows of %.60s", screen_name(screen));
+    attroff(COLOR_PAIR(COLOR_HEADER));
+    
+    if (cache == NULL || (cache->query_pid != 0 && cache->window_count == 0)) {
+        mvprintw(top + 1, 4, "Querying...");
+        return;
+    }
+    if (cache->state == WINDOWS_TIMEOUT && cache->window_count == 0) {
+        attron(COLOR_PAIR(COLOR_ERROR));
+        mvprintw(top + 1, 4, "No answer within %dms; the session server may be busy", WINDOW_QUERY_TIMEOUT_MS);
+        attroff(COLOR_PAIR(COLOR_ERROR));
+        return;
+    }
+    if (cache->state == WINDOWS_FAILED && cache->window_count == 0) {
+        attron(COLOR_PAIR(COLOR_ERROR));
+        mvprintw(top + 1, 4, "Window list unavailable (needs screen 4.1 or later for -Q)");
+        attroff(COLOR_PAIR(COLOR_ERROR));
+        return;
+    }
+    
+    /* Keep the last line for a count of the windows that do not fit */
+    shown = cache->window_count <= height - 2 ? cache->window_count : height - 3;
+    
+    mvprintw(top + 1, 4, "%-4s %-5s %-24s %s", "NUM", "FLAGS", "TITLE", "COMMAND");
+    for (i = 0; i < shown; i++) {
+        WindowInfo *window = &cache->windows[i];
+        
+        mvprintw(top + 2 + i, 4, "%-4d %-5s %-24.24s %.*s", window->number, window->flags,
+                 window->title, COLS > 45 ? COLS - 45 : 0, window->command);
+    }
+    if (shown < cache->window_count) {
+        mvprintw(top + 2 + shown, 4, "... %d more windows", cache->window_count - shown);
+    }
+}
+
+/*
+ * Open the log pane on a session's log. The file is mapped rather than
+ * read, so jumping to the end of a multi-gigabyte log only touches its
+ * last pages; an inotify watch on the log directory reports growth and
+ * the log being created or replaced.
+ */
+void log_open(const char *session) {
+    char dir[MAX_PATH_LENGTH];
+    char *slash;
+    
+    log_close();
+    memset(&log_view, 0, sizeof(log_view));
+    log_view.open = 1;
+    log_view.fd = -1;
+    log_view.watch_fd = -1;
+    log_view.follow = 1;
+    snprintf(log_view.session, sizeof(log_view.session), "%s", session);
+    if (session_log_path(session, log_view.path, sizeof(log_view.path)) != 0) {
+        return;
+    }
+    
+    snprintf(dir, sizeof(dir), "%s", log_view.path);
+    slash = strrchr(dir, '/');
+    *slash = '\0';
+    log_view.watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (log_view.watch_fd >= 0 &&
+        inotify_add_watch(log_view.watch_fd, dir, IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE) < 0) {
+        close(log_view.watch_fd);
+        log_view.watch_fd = -1;
+    }
+    
+    log_refresh(0);
+}
+
+void log_close() {
+    if (!log_view.open) {
+        return;
+    }
+    if (log_view.data != NULL) {
+        munmap((void *)log_view.data, log_view.size);
+    }
+    if (log_view.fd >= 0) {
+        close(log_view.fd);
+    }
+    if (log_view.watch_fd >= 0) {
+        close(log_view.watch_fd);
+    }
+    log_view.open = 0;
+}
+
+/*
+ * Bring the mapping up to the log's current size, opening the file again
+ * when reopen is set (it was replaced) or it did not exist before. A log
+ * that shrank keeps its view inside the new end. Called before every
+ * draw, search and key, so the mapping never reaches past the file's end.
+ */
+void log_refresh(int reopen) {
+    struct stat st;
+    void *data;
+    
+    if (reopen && log_view.fd >= 0) {
+        if (log_view.data != NULL) {
+            munmap((void *)log_view.data, log_view.size);
+        }
+        close(log_view.fd);
+        log_view.fd = -1;
+        log_view.data = NULL;
+        log_view.size = 0;
+    }
+    if (log_view.fd < 0) {
+        log_view.fd = open(log_view.path, O_RDONLY | O_CLOEXEC);
+        if (log_view.fd < 0) {
+            return;
+        }
+    }
+    if (fstat(log_view.fd, &st) != 0 || (size_t)st.st_size == log_view.size) {
+        return;
+    }
+    
+    if (st.st_size == 0) {
+        data = NULL;
+        if (log_view.data != NULL) {
+            munmap((void *)log_view.data, log_view.size);
+        }
+    } else if (log_view.data == NULL) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, log_view.fd, 0);
+    } else {
+        data = mremap((void *)log_view.data, log_view.size, st.st_size, MREMAP_MAYMOVE);
+    }
+    if (data == MAP_FAILED) {
+        /* Never keep a mapping longer than the file */
+        if ((size_t)st.st_size < log_view.size) {
+            munmap((void *)log_view.data, log_view.size);
+            log_view.data = NULL;
+            log_view.size = 0;
+        }
+        return;
+    }
+    log_view.data = data;
+    log_view.size = st.st_size;
+    
+    if (log_view.top > log_view.size) {
+        log_view.top = log_line_start(log_view.size);
+    }
+    if (log_view.has_match && log_view.match >= log_view.size) {
+        log_view.has_match = 0;
+    }
+}
+
+/* Apply inotify events for the open log; returns 1 if it changed */
+int log_process() {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const char *base = strrchr(log_view.path, '/') + 1;
+    int changed = 0, reopen = 0;
+    ssize_t n;
+    
+    if (!log_view.open || log_view.watch_fd < 0) {
+        return 0;
+    }
+    while ((n = read(log_view.watch_fd, buf, sizeof(buf))) > 0) {
+        char *p;
+        
+        for (p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            
+            if (event->len == 0 || strcmp(event->name, base) != 0) {
+                continue;
+            }
+            changed = 1;
+            if (event->mask & (IN_CREATE | IN_MOVED_TO | IN_DELETE)) {
+                reopen = 1;
+            }
+        }
+    }
+    if (changed) {
+        log_refresh(reopen);
+    }
+    return changed;
+}
+
+/* Start of the line containing offset */
+size_t log_line_start(size_t offset) {
+    const char *nl;
+    
+    if (offset > log_view.size) {
+        offset = log_view.size;
+    }
+    nl = offset > 0 ? memrchr(log_view.data, '\n', offset) : NULL;
+    return nl != NULL ? (size_t)(nl - log_view.data) + 1 : 0;
+}
+
+/* Start of the line before the one starting at offset */
+size_t log_line_prev(size_t offset) {
+    return offset > 0 ? log_line_start(offset - 1) : 0;
+}
+
+/* Start of the line after the one starting at offset, or offset on the last line */
+size_t log_line_next(size_t offset) {
+    const char *nl;
+    
+    if (offset >= log_view.size) {
+        return offset;
+    }
+    nl = memchr(log_view.data + offset, '\n', log_view.size - offset);
+    return nl != NULL && (size_t)(nl - log_view.data) + 1 < log_view.size ? (size_t)(nl - log_view.data) + 1 : offset;
+}
+
+/* First line on screen when the last rows lines are shown, found by scanning back from the end */
+size_t log_tail(int rows) {
+    size_t top = log_line_start(log_view.size > 0 && log_view.data[log_view.size - 1] == '\n' ?
+                                log_view.size - 1 : log_view.size);
+    
+    while (--rows > 0 && top > 0) {
+        top = log_line_prev(top);
+    }
+    return top;
+}
+
+/* Move the view by lines; scrolling stops following the end */
+void log_scroll(int lines) {
+    for (; lines < 0 && log_view.top > 0; lines++) {
+        log_view.top = log_line_prev(log_view.top);
+    }
+    for (; lines > 0; lines--) {
+        log_view.top = log_line_next(log_view.top);
+    }
+    log_view.follow = 0;
+}
+
+/*
+ * Copy one log line for display: terminal escape sequences and control
+ * characters are dropped and tabs expanded. Returns the length written.
+ */
+int log_render_line(const char *p, const char *end, char *out, int width) {
+    int n = 0;
+    
+    while (p < end && n < width) {
+        unsigned char c = (unsigned char)*p++;
+        
+        if (c == 27 && p < end) {
+            if (*p == '[') {
+                /* CSI: parameters up to a final byte in @..~ */
+                for (p++; p < end && (*p < '@' || *p > '~'); p++) {
+                }
+                p++;
+            } else if (*p == ']') {
+                /* OSC: up to BEL or the ESC of ST */
+                for (p++; p < end && *p != 7 && *p != 27; p++) {
+                }
+                if (p < end && *p == 7) {
+                    p++;
+                }
+            } else {
+                p++;
+            }
+        } else if (c == '\t') {
+            do {
+                out[n++] = ' ';
+            } while (n % 8 != 0 && n < width);
+        } else if (c >= 32 && c != 127) {
+            out[n++] = c;
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+/*
+ * Find the search text before (or after) the last match or the top line
+ * and show its line first. The backward search walks the mapping with
+ * memrchr, so only the pages between the view and the match are read.
+ */
+void log_search(int backward) {
+    char message[MAX_LINE_LENGTH];
+    size_t len = strlen(log_view.search);
+    size_t from = log_view.has_match ? log_view.match : log_view.top;
+    const char *found = NULL;
+    
+    /* A log truncated since the last event would fault past its new end */
+    log_refresh(0);
+    if (len == 0 || log_view.data == NULL) {
+        return;
+    }
+    
+    if (backward) {
+        size_t limit = from;
+        
+        while (limit > 0 && (found = memrchr(log_view.data, log_view.search[0], limit)) != NULL) {
+            if ((size_t)(found - log_view.data) + len <= log_view.size && memcmp(found, log_view.search, len) == 0) {
+                break;
+            }
+            limit = found - log_view.data;
+            found = NULL;
+        }
+    } else if (from + (log_view.has_match ? 1 : 0) < log_view.size) {
+        from += log_view.has_match ? 1 : 0;
+        found = memmem(log_view.data + from, log_view.size - from, log_view.search, len);
+    }
+    
+    if (found == NULL) {
+        snprintf(message, sizeof(message), "'%.100s' not found %s", log_view.search, backward ? "above" : "below");
+        set_status(message, COLOR_ERROR);
+        return;
+    }
+    log_view.match = found - log_view.data;
+    log_view.has_match = 1;
+    log_view.top = log_line_start(log_view.match);
+    log_view.follow = 0;
+}
+
+/* Keys of the log pane; ? edits the search text */
+void handle_log_input(int ch) {
+    int rows = LINES - 7 > 1 ? LINES - 7 : 1;
+    
+    log_refresh(0);
+
+    if (log_view.search_editing) {
+        if (ch == '\n') {
+            log_view.search_editing = 0;
+            log_view.has_match = 0;
+            curs_set(0);
+            log_search(1);
+        } else if (ch == 27) {
+            log_view.search_editing = 0;
+            curs_set(0);
+        } else if (ch == KEY_BACKSPACE || ch == 127) {
+            if (log_view.search_len > 0) {
+                log_view.search[--log_view.search_len] = '\0';
+            }
+        } else if (isprint(ch) && log_view.search_len < MAX_NAME_LENGTH - 1) {
+            log_view.search[log_view.search_len++] = ch;
+            log_view.search[log_view.search_len] = '\0';
+        }
+        return;
+    }
+    
+    switch (ch) {
+        case KEY_UP:
+            log_scroll(-1);
+            break;
+        case KEY_DOWN:
+            log_scroll(1);
+            break;
+        case KEY_PPAGE:
+            log_scroll(-rows);
+            break;
+        case KEY_NPAGE:
+            log_scroll(rows);
+            break;
+        case KEY_HOME:
+        case 'g':
+            log_view.top = 0;
+            log_view.follow = 0;
+            break;
+        case KEY_END:
+        case 'G':
+            log_view.follow = 1;
+            break;
+        case 'f':
+            log_view.follow = !log_view.follow;
+            break;
+        case '?':
+            log_view.search_editing = 1;
+            log_view.search_len = 0;
+            log_view.search[0] = '\0';
+            curs_set(1);
+            break;
+        case 'n':
+            log_search(1);
+            break;
+        case 'N':
+            log_search(0);
+            break;
+        case 'q':
+        case KEY_BACKSPACE:
+        case 27: /* ESC key */
+            log_close();
+            current_menu = MENU_BROWSE;
+            break;
+    }
+}
+
+void draw_log_menu(WINDOW *win) {
+    char line[MAX_LINE_LENGTH];
+    char size[32];
+    int width, height;
+    int rows, y;
+    size_t offset;
+    
+    getmaxyx(win, height, width);
+    werase(win);
+    rows = height - 7 > 1 ? height - 7 : 1;
+    
+    /*
+     * Catch up with a log that changed without an event, e.g. no watch. This
+     * also shrinks the mapping of a log truncated behind our back (: > log,
+     * copytruncate), whose pages past the new end would raise SIGBUS.
+     */
+    log_refresh(0);
+    if (log_view.follow) {
+        log_view.top = log_tail(rows);
+    }
+    
+    attron(COLOR_PAIR(COLOR_HEADER));
+    mvprintw(1, 2, "SESSION LOG: %.60s%s", log_view.session, log_view.follow ? "  (following)" : "");
+    attroff(COLOR_PAIR(COLOR_HEADER));
+    
+    format_kb(log_view.size / 1024, size, sizeof(size));
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(2, 2, "%.*s (%s)", width > 20 ? width - 20 : 0, log_view.path, size);
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    if (log_view.data == NULL) {
+        mvprintw(4, 4, "%s", log_view.fd < 0 ? "No log yet: the session was started without logging, or has not written one"
+                                               : "The log is empty");
+    }
+    
+    offset = log_view.top;
+    for (y = 0; y < rows && log_view.data != NULL && offset < log_view.size; y++) {
+        const char *start = log_view.data + offset;
+        const char *end = memchr(start, '\n', log_view.size - offset);
+        int highlight;
+        
+        if (end == NULL) {
+            end = log_view.data + log_view.size;
+        }
+        highlight = log_view.has_match && log_view.match >= offset && log_view.match < (size_t)(end - log_view.data);
+        log_render_line(start, end, line, width - 4 < (int)sizeof(line) - 1 ? width - 4 : (int)sizeof(line) - 1);
+        if (highlight) {
+            attron(COLOR_PAIR(COLOR_SELECTED));
+        }
+        mvprintw(4 + y, 2, "%s", line);
+        if (highlight) {
+            attroff(COLOR_PAIR(COLOR_SELECTED));
+        }
+        offset = end - log_view.data + 1;
+    }
+    
+    draw_status_line(height);
+    
+    attron(COLOR_PAIR(COLOR_HELP));
+    if (log_view.search_editing) {
+        mvprintw(height - 1, 2, "Search back: %s", log_view.search);
+    } else {
+        mvprintw(height - 1, 2, "UP/DOWN/PGUP/PGDN: scroll, g/G: start/end, f: follow, ?: search back, n/N: next match back/forward, q: back");
+    }
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    refresh();
+}
+
+/* Screen browser display */
+void draw_screens(WINDOW *win) {
+    int rows;
+    
+    /* The pane follows the selection, so every move repaints it */
+    if (window_pane) {
+        needs_full_redraw = 1;
+    }
+    draw_session_list(win, "SCREEN BROWSER",
+                      "UP/DOWN/PGUP/PGDN: navigate, Enter: activate, /: filter, o: sort, w: windows, v: log, r: refresh, q: back");
+    
+    if (window_pane) {
+        rows = list_rows();
+        draw_window_pane(LIST_START_Y + rows + 1, LINES - 3 - (LIST_START_Y + rows + 1));
+        refresh();
+    }
+}
+
+/* Shared session list for the browse and kill menus; only visible rows are formatted */
+void draw_session_list(WINDOW *win, const char *title, const char *help) {
+    int i, rows, count;
+    int width, height;
+    
+    getmaxyx(win, height, width);
+    (void)width;
+    rows = list_rows();
+    count = view_rows();
+    list_clamp(&selected_index, &screen_top, count, rows);
+    
+    /* Cursor movement inside the viewport only touches the old and new rows */
+    if (!needs_full_redraw) {
+        for (i = 0; i < dirty_count; i++) {
+            draw_screen_row(dirty_rows[i]);
+        }
+        draw_filter_prompt();
+        refresh();
+        return;
+    }
+    
+    werase(win);
+    
+    /* Draw header */
+    attron(COLOR_PAIR(COLOR_HEADER));
+    mvprintw(1, 2, "%s", title);
+    attroff(COLOR_PAIR(COLOR_HEADER));
+    
+    /* Draw help text */
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(2, 2, "%s", help);
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    /* Draw header row */
+    mvprintw(LIST_START_Y - 1, 2, "%-5s %-10s %-20s %-25s %-10s %7s %6s %5s",
+             "#", "PID", "NAME", "TIMESTAMP", "STATUS", "RSS", "CPU%", "PROCS");
+    
+    /* If no screens found */
+    if (count == 0) {
+        attron(COLOR_PAIR(COLOR_ERROR));
+        mvprintw(LIST_START_Y + 1, 2, screen_count == 0 ? "No screen sessions found." : "No sessions match the filter.");
+        attroff(COLOR_PAIR(COLOR_ERROR));
+    } else {
+        /* Draw the visible window of the screen list */
+        for (i = screen_top; i < count && i < screen_top + rows; i++) {
+            draw_screen_row(i);
+        }
+    }
+    
+    draw_status_line(height);
+    
+    /* Draw footer */
+    attron(COLOR_PAIR(COLOR_HELP));
+    if (filter_len > 0) {
+        mvprintw(height - 1, 2, "Matched %d of %d screen sessions", count, screen_count);
+    } else {
+        mvprintw(height - 1, 2, "Found %d screen sessions", count);
+    }
+    if (count > rows) {
+        printw(" (showing %d-%d)", screen_top + 1, screen_top + rows < count ? screen_top + rows : count);
+    }
+    if (current_menu == MENU_KILL && marked_count > 0) {
+        printw(", %d marked", marked_count);
+    }
+    if (list_sort != SORT_NONE) {
+        printw(", sorted by %s", sort_names[list_sort]);
+    }
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    draw_filter_prompt();
+    refresh();
+}
+
+/* Draw one row of the (filtered) session list at its viewport position */
+void draw_screen_row(int row) {
+    int y = LIST_START_Y + row - screen_top;
+    int selected = (row == selected_index);
+    int status_color;
+    char created[32];
+    char rss[16], cpu[16], procs[16];
+    Screen *screen;
+    
+    if (row < screen_top || row >= screen_top + list_rows() || row >= view_rows()) {
+        return;
+    }
+    screen = &screens[view_screen(row)];
+    
+    /* Only visible rows get their timestamp formatted */
+    screen_format_time(screen, created, sizeof(created));
+    
+    attron(COLOR_PAIR(selected ? COLOR_SELECTED : COLOR_NORMAL));
+    mvprintw(y, 0, "%c", current_menu == MENU_KILL && screen->marked ? '*' : ' ');
+    mvprintw(y, 2, "%-5d %-10d ", row + 1, (int)screen->pid);
+    draw_filtered_name(screen_name(screen), 20);
+    printw(" %-25s ", created);
+    attroff(COLOR_PAIR(selected ? COLOR_SELECTED : COLOR_NORMAL));
+    
+    /* Print status with different color */
+    status_color = screen->state == SCREEN_ATTACHED ? COLOR_STATUS_ATTACHED :
+                   screen->state == SCREEN_DEAD ? COLOR_ERROR : COLOR_STATUS_DETACHED;
+    attron(COLOR_PAIR(selected ? COLOR_SELECTED : status_color));
+    printw("%-10s", screen_state_names[screen->state]);
+    attroff(COLOR_PAIR(selected ? COLOR_SELECTED : status_color));
+    
+    /* Usage of the session's process tree, "-" until the first scan */
+    strcpy(rss, "-");
+    strcpy(cpu, "-");
+    strcpy(procs, "-");
+    if (screen->usage_seen) {
+        format_kb(screen->rss_kb, rss, sizeof(rss));
+        snprintf(cpu, sizeof(cpu), "%u.%u", screen->cpu / 10, screen->cpu % 10);
+        snprintf(procs, sizeof(procs), "%u", screen->procs);
+    }
+    attron(COLOR_PAIR(selected ? COLOR_SELECTED : COLOR_NORMAL));
+    printw(" %7s %6s %5s", rss, cpu, procs);
+    attroff(COLOR_PAIR(selected ? COLOR_SELECTED : COLOR_NORMAL));
+    clrtoeol();
+}
+
+/* Create screen menu display */
+void draw_create_menu(WINDOW *win) {
+    int width, height;
+    getmaxyx(win, height, width);
+    
+    werase(win);
+    
+    /* Draw header */
+    attron(COLOR_PAIR(COLOR_HEADER));
+    mvprintw(1, 2, "CREATE NEW SCREEN");
+    attroff(COLOR_PAIR(COLOR_HEADER));
+    
+    /* Draw help text */
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(2, 2, "Enter screen name and press Enter to create, ESC to cancel");
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    /* Draw input field */
+    attron(COLOR_PAIR(COLOR_NORMAL));
+    mvprintw(4, 2, "Screen Name: ");
+    mvprintw(4, 15, "%s", new_screen_name);
+    attroff(COLOR_PAIR(COLOR_NORMAL));
+    
+    /* Position cursor at end of input */
+    move(4, 15 + cursor_pos);
+    
+    draw_status_line(height);
+    
+    refresh();
+}
+
+/* Kill screen menu display */
+void draw_kill_menu(WINDOW *win) {
+    draw_session_list(win, "KILL SCREEN SESSION",
+                      "Space: mark, a: mark detached, m: mark by pattern, u: unmark, /: filter, o: sort, Enter: kill marked (or current)");
+    
+    /* Pattern prompt replaces the status line while it is open */
+    if (pattern_active) {
+        move(LINES - 2, 0);
+        clrtoeol();
+        attron(COLOR_PAIR(COLOR_HELP));
+        mvprintw(LINES - 2, 2, "Mark sessions matching (glob): ");
+        attroff(COLOR_PAIR(COLOR_HELP));
+        printw("%s", kill_pattern);
+        refresh();
+    }
+}
+
+/* Project templates menu display */
+void draw_project_menu(WINDOW *win) {
+    int i;
+    int start_y = 4;
+    int width, height;
+    
+    int rows;
+    
+    getmaxyx(win, height, width);
+    (void)width;
+    
+    /* Leave the lower part of the window for the component details */
+    rows = (height - start_y - 3) / 2;
+    if (rows < 1) {
+        rows = 1;
+    }
+    list_clamp(&selected_project, &project_top, project_count, rows);
+    
+    werase(win);
+    
+    /* Draw header */
     attron(COLOR_PAIR(COLOR_HEADER));
     mvprintw(1, 2, "PROJECT TEMPLATES");
     attroff(COLOR_PAIR(COLOR_HEADER));
     
-    /* Draw help text */
-    attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(2, 2, "Use UP/DOWN to navigate, Enter to create project screens, q to go back");
-    attroff(COLOR_PAIR(COLOR_HELP));
+    /* Draw help text */
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(2, 2, "Use UP/DOWN to navigate, Enter to create project screens, q to go back");
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    /* If no projects found */
+    if (project_count == 0) {
+        attron(COLOR_PAIR(COLOR_ERROR));
+        mvprintw(start_y + 1, 2, "No project templates found.");
+        attroff(COLOR_PAIR(COLOR_ERROR));
+    } else {
+        /* Draw project list */
+        for (i = project_top; i < project_count && i < project_top + rows; i++) {
+            if (i == selected_project) {
+                attron(COLOR_PAIR(COLOR_SELECTED));
+                mvprintw(start_y + i - project_top, 2, "%-5d %s", i + 1, projects[i].name);
+                attroff(COLOR_PAIR(COLOR_SELECTED));
+            } else {
+                attron(COLOR_PAIR(COLOR_NORMAL));
+                mvprintw(start_y + i - project_top, 2, "%-5d %s", i + 1, projects[i].name);
+                attroff(COLOR_PAIR(COLOR_NORMAL));
+            }
+        }
+        
+        /* Draw selected project details */
+        if (project_count > 0) {
+            int shown = project_count - project_top < rows ? project_count - project_top : rows;
+            int detail_y = start_y + shown + 2;
+            
+            if (detail_y < height - 4) {
+                attron(COLOR_PAIR(COLOR_HEADER));
+                mvprintw(detail_y, 2, "Components for %s:", projects[selected_project].name);
+                attroff(COLOR_PAIR(COLOR_HEADER));
+                
+                for (i = 0; i < projects[selected_project].num_components; i++) {
+                    if (detail_y + i + 1 >= height - 3) {
+                        break;
+                    }
+                    
+                    const ProjectComponent *component = &projects[selected_project].components[i];
+                    
+                    attron(COLOR_PAIR(COLOR_NORMAL));
+                    mvprintw(detail_y + i + 1, 4, "- %-30s", component->name);
+                    if (component->command != NULL) {
+                        printw(" %.*s", width > 80 ? width - 60 : 20, component->command);
+                    }
+                    attroff(COLOR_PAIR(COLOR_NORMAL));
+                    
+                    /* Result of the last launch of this template */
+                    if (launch_project == selected_project && i < launch_job_count) {
+                        int color = launch_jobs[i].state == JOB_FAILED ? COLOR_ERROR :
+                                    launch_jobs[i].state == JOB_SKIPPED ? COLOR_STATUS_DETACHED : COLOR_SUCCESS;
+                        attron(COLOR_PAIR(color));
+                        printw(" [%s]", job_state_label(launch_jobs[i].state));
+                        attroff(COLOR_PAIR(color));
+                    }
+                }
+            }
+        }
+    }
+    
+    draw_status_line(height);
+    
+    refresh();
+}
+
+/* Project list menu display */
+void draw_project_list_menu(WINDOW *win) {
+    int i, rows;
+    int width, height;
+    
+    getmaxyx(win, height, width);
+    (void)width;
+    rows = list_rows();
+    list_clamp(&selected_project_entry, &project_entry_top, project_entry_count, rows);
+    
+    if (!needs_full_redraw) {
+        for (i = 0; i < dirty_count; i++) {
+            draw_project_entry_row(dirty_rows[i]);
+        }
+        refresh();
+        return;
+    }
+    
+    werase(win);
+    
+    /* Draw header */
+    attron(COLOR_PAIR(COLOR_HEADER));
+    mvprintw(1, 2, "PROJECT LIST");
+    attroff(COLOR_PAIR(COLOR_HEADER));
+    
+    /* Draw help text */
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(2, 2, "Use UP/DOWN/PGUP/PGDN to navigate, Enter to create screens, r to refresh, q to go back");
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    /* If no projects found */
+    if (project_entry_count == 0) {
+        attron(COLOR_PAIR(COLOR_ERROR));
+        mvprintw(LIST_START_Y + 1, 2, "No projects found.");
+        attroff(COLOR_PAIR(COLOR_ERROR));
+    } else {
+        /* Draw project list with headers */
+        mvprintw(LIST_START_Y - 1, 2, "%-5s %-30s %-50s", "#", "KEY", "DIRECTORY");
+        
+        /* Draw the visible window of project entries */
+        for (i = project_entry_top; i < project_entry_count && i < project_entry_top + rows; i++) {
+            draw_project_entry_row(i);
+        }
+    }
+    
+    draw_status_line(height);
+    
+    /* Draw footer */
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(height - 1, 2, "Found %d projects", project_entry_count);
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    refresh();
+}
+
+/* Draw one project entry row at its viewport position */
+void draw_project_entry_row(int i) {
+    int color = (i == selected_project_entry) ? COLOR_SELECTED : COLOR_NORMAL;
+    
+    if (i < project_entry_top || i >= project_entry_top + list_rows() || i >= project_entry_count) {
+        return;
+    }
+    
+    attron(COLOR_PAIR(color));
+    mvprintw(LIST_START_Y + i - project_entry_top, 2, "%-5d %-30s %-50s", 
+            i + 1, 
+            project_entries[i].key, 
+            project_entries[i].directory);
+    attroff(COLOR_PAIR(color));
+    clrtoeol();
+}
+
+/* Statistics menu display */
+void draw_stats_menu(WINDOW *win) {
+    int width, height;
+    int i;
+    
+    getmaxyx(win, height, width);
+    (void)width;
+    werase(win);
+    
+    /* Draw header */
+    attron(COLOR_PAIR(COLOR_HEADER));
+    mvprintw(1, 2, "STATISTICS");
+    attroff(COLOR_PAIR(COLOR_HEADER));
+    
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(2, 2, "Latencies of the hot paths since start (ms), p99 over the last %d samples", STAT_SAMPLES);
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    attron(COLOR_PAIR(COLOR_HEADER));
+    mvprintw(4, 2, "%-18s %8s %10s %10s %10s %10s", "PATH", "COUNT", "LAST", "AVG", "P99", "MAX");
+    attroff(COLOR_PAIR(COLOR_HEADER));
+    
+    attron(COLOR_PAIR(COLOR_NORMAL));
+    for (i = 0; i < STAT_COUNT && 5 + i < height - 3; i++) {
+        const Stat *stat = &stats[i];
+        
+        mvprintw(5 + i, 2, "%-18s %8lu %10.3f %10.3f %10.3f %10.3f", stat_names[i], stat->count,
+                 stat->last_us / 1000, stat->count ? stat->total_us / stat->count / 1000 : 0.0,
+                 stat_percentile(stat, 99) / 1000, stat->max_us / 1000);
+    }
+    attroff(COLOR_PAIR(COLOR_NORMAL));
+    
+    draw_status_line(height);
+    
+    /* Draw footer */
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(height - 1, 2, "r: reset counters, q/ESC: back to main menu");
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    refresh();
+}
+
+/* Help menu display */
+void draw_help_menu(WINDOW *win) {
+    int width, height;
+    getmaxyx(win, height, width);
+    
+    werase(win);
+    
+    /* Draw header */
+    attron(COLOR_PAIR(COLOR_HEADER));
+    mvprintw(1, 2, "HELP");
+    attroff(COLOR_PAIR(COLOR_HEADER));
+    
+    /* Draw help content */
+    attron(COLOR_PAIR(COLOR_NORMAL));
+    int y = 3;
+    mvprintw(y++, 2, "Scream - A Comprehensive Screen Management Tool");
+    y++;
+    mvprintw(y++, 2, "Main Menu:");
+    mvprintw(y++, 4, "1 or b: Browse screen sessions");
+    mvprintw(y++, 4, "2 or c: Create a new screen session");
+    mvprintw(y++, 4, "3 or k: Kill a screen session");
+    mvprintw(y++, 4, "4 or p: Select a project template");
+    mvprintw(y++, 4, "5, h or ?: Show this help");
+    mvprintw(y++, 4, "6 or l: Load project list and create screens");
+    mvprintw(y++, 4, "7 or s: Show timing statistics");
+    mvprintw(y++, 4, "q: Quit");
+    y++;
+    mvprintw(y++, 2, "Navigation:");
+    mvprintw(y++, 4, "UP/DOWN: Move selection");
+    mvprintw(y++, 4, "ENTER: Select/Activate");
+    mvprintw(y++, 4, "ESC or q: Go back");
+    mvprintw(y++, 4, "r: Refresh screen list");
+    mvprintw(y++, 4, "Ctrl-X: Cancel operations running in the background");
+    y++;
+    mvprintw(y++, 2, "Screen Sessions:");
+    mvprintw(y++, 4, "- Browse mode: View and connect to existing sessions, v shows a session's log");
+    mvprintw(y++, 4, "- Create mode: Start a new named screen session");
+    mvprintw(y++, 4, "- Kill mode: Terminate a screen session");
+    mvprintw(y++, 4, "- Project mode: Create multiple sessions from a template");
+    attroff(COLOR_PAIR(COLOR_NORMAL));
+    
+    /* Draw footer */
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(height - 1, 2, "Press any key to return to main menu");
+    attroff(COLOR_PAIR(COLOR_HELP));
+    
+    refresh();
+}
+
+/* Activate a screen session */
+void activate_screen(int index) {
+    char message[MAX_LINE_LENGTH];
+    
+    endwin(); /* End ncurses mode */
+    
+    printf("\nActivating %s session: %s\n", backend->name, screen_id(&screens[index]));
+    backend->attach(&screens[index]);
+    
+    /* Restart ncurses mode */
+    refresh();
+    
+    /* Return to main menu */
+    current_menu = MENU_MAIN;
+    snprintf(message, sizeof(message), "Returned from %s session", backend->name);
+    set_status(message, COLOR_SUCCESS);
+}
+
+/* screen -r in the foreground; screen needs the terminal, so it inherits our stdio */
+void screen_attach(const Screen *screen) {
+    char *argv[] = { "screen", "-r", (char *)screen_id(screen), NULL };
+    SpawnResult result;
+    
+    spawn_command(argv, 1, &result);
+}
+
+/* Kill a screen session; it leaves the table once screen has confirmed */
+void kill_screen(int index) {
+    Operation *op = op_new("kill", 1, kill_one_complete);
+    
+    if (op == NULL) {
+        set_status("Out of memory", COLOR_ERROR);
+        return;
+    }
+    kill_job_init(&op->jobs[0], screen_id(&screens[index]));
+    snprintf(op->label, sizeof(op->label), "kill %.64s", screen_name(&screens[index]));
+    op_submit(op);
+}
+
+/* Set up a job killing the session with the given id (screen -S id -X quit) */
+void kill_job_init(Job *job, const char *id) {
+    snprintf(job->target, sizeof(job->target), "%s", id);
+    job->kind = JOB_KIND_KILL;
+    job->argv[0] = "screen";
+    job->argv[1] = "-S";
+    job->argv[2] = job->target;
+    job->argv[3] = "-X";
+    job->argv[4] = "quit";
+    job->argv[5] = NULL;
+    job->state = JOB_PENDING;
+}
+
+/* Drop the killed sessions from the table directly instead of refetching, and report */
+void kill_complete(Operation *op) {
+    char message[MAX_LINE_LENGTH];
+    int killed = 0, failed = 0, cancelled = 0;
+    int i, found;
+    
+    for (i = 0; i < op->job_count; i++) {
+        Job *job = &op->jobs[i];
+        
+        if (job->state == JOB_DONE) {
+            killed++;
+            found = screen_find_by_pid((pid_t)atol(job->target));
+            if (found >= 0 && strcmp(screen_id(&screens[found]), job->target) == 0) {
+                screen_table_remove(found);
+            }
+        } else if (job->state == JOB_CANCELLED) {
+            cancelled++;
+        } else {
+            failed++;
+        }
+    }
+    
+    snprintf(message, sizeof(message), "Killed %d sessions, %d failed", killed, failed);
+    if (cancelled > 0) {
+        size_t len = strlen(message);
+        snprintf(message + len, sizeof(message) - len, ", %d cancelled", cancelled);
+    }
+    set_status(message, failed + cancelled > 0 ? COLOR_ERROR : COLOR_SUCCESS);
+}
+
+/* Single-session kill: same bookkeeping, with the message the kill menu always gave */
+void kill_one_complete(Operation *op) {
+    char message[MAX_LINE_LENGTH];
+    Job *job = &op->jobs[0];
+    
+    kill_complete(op);
+    if (job->state == JOB_DONE) {
+        snprintf(message, sizeof(message), "Screen session killed successfully");
+    } else if (job->state == JOB_CANCELLED) {
+        snprintf(message, sizeof(message), "Kill cancelled");
+    } else {
+        snprintf(message, sizeof(message), "Failed to kill screen session%s%.200s",
+                 job->result.error[0] ? ": " : "", job->result.error);
+    }
+    set_status(message, job->state == JOB_DONE ? COLOR_SUCCESS : COLOR_ERROR);
+}
+
+/* Create a new screen session in the background */
+void create_screen(char *name) {
+    Operation *op = op_new("create", 1, create_complete);
+    
+    if (op == NULL) {
+        set_status("Out of memory", COLOR_ERROR);
+        return;
+    }
+    create_job_init(&op->jobs[0], name);
+    snprintf(op->label, sizeof(op->label), "create %.64s", name);
+    op_submit(op);
+}
+
+/* Set up a job creating a detached session (screen -dmS name) */
+void create_job_init(Job *job, const char *name) {
+    char path[MAX_PATH_LENGTH];
+    int argc = 3;
+    
+    snprintf(job->target, sizeof(job->target), "%s", name);
+    job->kind = JOB_KIND_CREATE;
+    job->argv[0] = "screen";
+    job->argv[1] = "-dmS";
+    job->argv[2] = job->target;
+    
+    /* Record the session's output for the log pane */
+    if (session_log_enabled() && session_log_path(name, path, sizeof(path)) == 0) {
+        job->logfile = strdup(path);
+    }
+    if (job->logfile != NULL && backend == &screen_backend) {
+        job->argv[argc++] = "-L";
+        job->argv[argc++] = "-Logfile";
+        job->argv[argc++] = job->logfile;
+    }
+    job->argv[argc] = NULL;
+    job->state = JOB_PENDING;
+}
+
+/* Run the job's script with sh -c in the first window instead of a login shell */
+void create_job_script(Job *job) {
+    int argc = 0;
+    
+    while (job->argv[argc] != NULL) {
+        argc++;
+    }
+    job->argv[argc++] = "/bin/sh";
+    job->argv[argc++] = "-c";
+    job->argv[argc++] = job->script;
+    job->argv[argc] = NULL;
+}
+
+/* Session logging is on unless SCREAM_LOG=0, and with screen needs -Logfile */
+int session_log_enabled() {
+    const char *value = getenv("SCREAM_LOG");
+    
+    if (value != NULL && strcmp(value, "0") == 0) {
+        return 0;
+    }
+    return backend != &screen_backend || screen_logfile_supported();
+}
+
+/*
+ * Log file of a session: $XDG_STATE_HOME/scream/logs/NAME.log, with '/' in
+ * the name replaced. The directory is set up on first use.
+ */
+int session_log_path(const char *name, char *buf, size_t len) {
+    static char dir[MAX_PATH_LENGTH];
+    static int dir_state = 0;   /* 1 ready, -1 unusable */
+    char *p;
+    
+    if (dir_state == 0) {
+        dir_state = state_file_path("logs", dir, sizeof(dir)) == 0 &&
+                    (mkdir(dir, 0700) == 0 || errno == EEXIST) ? 1 : -1;
+    }
+    if (dir_state < 0 || snprintf(buf, len, "%s/%s.log", dir, name) >= (int)len) {
+        return -1;
+    }
+    for (p = buf + strlen(dir) + 1; (p = strchr(p, '/')) != NULL; p++) {
+        *p = '_';
+    }
+    return 0;
+}
+
+/*
+ * Whether screen takes -Logfile, which came with 4.6: older versions read
+ * it as a bundle of single-letter options and refuse to start. screen -v
+ * is asked once per run.
+ */
+int screen_logfile_supported() {
+    static int supported = -1;
+    char *argv[] = { "screen", "-v", NULL };
+    char output[256];
+    const char *version;
+    size_t used = 0;
+    int out_fd, err_fd, status, major = 0, minor = 0;
+    SpawnResult result;
+    ssize_t n;
+    pid_t pid;
+    
+    if (supported >= 0) {
+        return supported;
+    }
+    supported = 0;
+    
+    pid = spawn_start(argv, NULL, NULL, &out_fd, &err_fd, 0);
+    if (pid < 0) {
+        return supported;
+    }
+    while (used < sizeof(output) - 1 && (n = read(out_fd, output + used, sizeof(output) - 1 - used)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        used += n;
+    }
+    output[used] = '\0';
+    close(out_fd);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    spawn_finish(status, err_fd, &result);
+    
+    /* "Screen version 4.09.01 (GNU) 20-Aug-23" */
+    version = strstr(output, "version ");
+    if (version != NULL && sscanf(version + 8, "%d.%d", &major, &minor) == 2) {
+        supported = major > 4 || (major == 4 && minor >= 6);
+    }
+    return supported;
+}
+
+void create_complete(Operation *op) {
+    char message[MAX_LINE_LENGTH];
+    Job *job = &op->jobs[0];
+    
+    if (job->state == JOB_DONE) {
+        set_status("Screen session created successfully", COLOR_SUCCESS);
+    } else if (job->state == JOB_CANCELLED) {
+        set_status("Screen session creation cancelled", COLOR_ERROR);
+    } else {
+        snprintf(message, sizeof(message), "Failed to create screen session%s%.200s",
+                 job->result.error[0] ? ": " : "", job->result.error);
+        set_status(message, COLOR_ERROR);
+    }
+}
+
+/*
+ * Start argv[0] (searched in PATH) without a shell. Non-interactive children get
+ * /dev/null for stdin, a pipe for stderr returned through err_fd, and for stdout
+ * either /dev/null or, when out_fd is given, a blocking pipe the caller reads to
+ * EOF; interactive ones inherit the terminal. Returns the pid, or -1 on failure.
+ */
+pid_t spawn_start(char *const argv[], const char *cwd, char *const envp[], int *out_fd, int *err_fd, int interactive) {
+    posix_spawn_file_actions_t actions;
+    int pipefd[2] = { -1, -1 };
+    int outfd[2] = { -1, -1 };
+    pid_t pid;
+    int rc;
+    
+    *err_fd = -1;
+    if (out_fd != NULL) {
+        *out_fd = -1;
+    }
+    if (envp == NULL) {
+        envp = environ;
+    }
+    if (interactive) {
+        rc = posix_spawnp(&pid, argv[0], NULL, NULL, argv, envp);
+        if (rc != 0) {
+            errno = rc;
+        }
+        return rc == 0 ? pid : -1;
+    }
+    
+    if (pipe2(pipefd, O_CLOEXEC) != 0) {
+        return -1;
+    }
+    if (out_fd != NULL && pipe2(outfd, O_CLOEXEC) != 0) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
+    
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    if (out_fd != NULL) {
+        posix_spawn_file_actions_adddup2(&actions, outfd[1], STDOUT_FILENO);
+    } else {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDERR_FILENO);
+    if (cwd != NULL) {
+        posix_spawn_file_actions_addchdir_np(&actions, cwd);
+    }
+    
+    rc = posix_spawnp(&pid, argv[0], &actions, NULL, argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipefd[1]);
+    if (out_fd != NULL) {
+        close(outfd[1]);
+    }
+    
+    if (rc != 0) {
+        close(pipefd[0]);
+        if (out_fd != NULL) {
+            close(outfd[0]);
+        }
+        errno = rc;
+        return -1;
+    }
+    
+    /*
+     * Never wait for EOF on stderr: daemons such as a detached screen
+     * server may keep the write end open long after the client exits.
+     */
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+    *err_fd = pipefd[0];
+    if (out_fd != NULL) {
+        *out_fd = outfd[0];
+    }
+    return pid;
+}
+
+/* Record the wait status and buffered stderr of a reaped child; returns its exit code */
+int spawn_finish(int status, int err_fd, SpawnResult *result) {
+    ssize_t len;
+    
+    result->error[0] = '\0';
+    result->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    
+    if (err_fd >= 0) {
+        len = read(err_fd, result->error, sizeof(result->error) - 1);
+        result->error[len > 0 ? len : 0] = '\0';
+        result->error[strcspn(result->error, "\n")] = '\0';
+        close(err_fd);
+    }
+    
+    return result->status;
+}
+
+/* Run a command to completion; returns its exit code, or -1 if it could not be started */
+int spawn_command(char *const argv[], int interactive, SpawnResult *result) {
+    int err_fd, status;
+    double start = monotonic_us();
+    pid_t pid;
+    
+    pid = spawn_start(argv, NULL, NULL, NULL, &err_fd, interactive);
+    if (pid < 0) {
+        result->status = -1;
+        snprintf(result->error, sizeof(result->error), "cannot run %s: %s", argv[0], strerror(errno));
+        return -1;
+    }
+    
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            result->status = -1;
+            result->error[0] = '\0';
+            return -1;
+        }
+    }
+    
+    /* Interactive children run until the user detaches, which is not spawn cost */
+    if (!interactive) {
+        stat_record(STAT_SPAWN, start);
+    }
+    
+    return spawn_finish(status, err_fd, result);
+}
+
+/*
+ * Load project templates. Templates come from *.conf files in the template
+ * directories (built-in defaults when there are none) and are compiled into
+ * $XDG_CACHE_HOME/scream/templates.bin. On later starts that file is mapped
+ * directly and the sources are only re-parsed when one of them changed.
+ */
+void load_projects() {
+    char cache[MAX_PATH_LENGTH];
+    char **paths = NULL;
+    int path_count = template_source_list(&paths);
+    int have_cache = cache_file_path("templates.bin", cache, sizeof(cache)) == 0;
+    TemplateBuilder builder;
+    char message[MAX_LINE_LENGTH];
+    void *image;
+    size_t size;
+    int i, fd;
+    double start = monotonic_us();
+    
+    /* Fast path: the compiled image is still up to date */
+    if (have_cache && (fd = open(cache, O_RDONLY | O_CLOEXEC)) >= 0) {
+        struct stat st;
+        
+        image = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        
+        if (image != MAP_FAILED) {
+            if (template_image_valid(image, st.st_size, paths, path_count) &&
+                projects_from_image(image, st.st_size) == 0) {
+                template_image = image;
+                template_image_size = st.st_size;
+                template_image_mapped = 1;
+                goto done;
+            }
+            munmap(image, st.st_size);
+        }
+    }
+    
+    /* Compile the sources */
+    memset(&builder, 0, sizeof(builder));
+    builder_string(&builder, "");
+    if (path_count == 0) {
+        builder_parse(&builder, default_templates, "built-in templates");
+    }
+    for (i = 0; i < path_count; i++) {
+        TemplateCacheSource *source;
+        struct stat st;
+        char *text;
+        FILE *fp = fopen(paths[i], "r");
+        
+        if (fp == NULL || fstat(fileno(fp), &st) != 0) {
+            builder_error(&builder, paths[i], 0, strerror(errno));
+            if (fp != NULL) {
+                fclose(fp);
+            }
+            continue;
+        }
+        
+        builder.sources = grow_array(builder.sources, &builder.source_capacity,
+                                     builder.source_count, sizeof(TemplateCacheSource));
+        source = &builder.sources[builder.source_count++];
+        memset(source, 0, sizeof(*source));
+        source->mtime_sec = st.st_mtim.tv_sec;
+        source->mtime_nsec = st.st_mtim.tv_nsec;
+        source->size = st.st_size;
+        source->path = builder_string(&builder, paths[i]);
+        
+        text = calloc(st.st_size + 1, 1);
+        if (text != NULL && fread(text, 1, st.st_size, fp) == (size_t)st.st_size) {
+            builder_parse(&builder, text, paths[i]);
+        }
+        free(text);
+        fclose(fp);
+    }
+    
+    image = builder_image(&builder, &size);
+    if (have_cache) {
+        char tmp[MAX_PATH_LENGTH + 8];
+        FILE *fp;
+        
+        snprintf(tmp, sizeof(tmp), "%s.tmp", cache);
+        fp = fopen(tmp, "w");
+        if (fp != NULL) {
+            int ok = fwrite(image, 1, size, fp) == size;
+            
+            if (fclose(fp) == 0 && ok) {
+                rename(tmp, cache);
+            } else {
+                unlink(tmp);
+            }
+        }
+    }
+    
+    template_image = image;
+    template_image_size = size;
+    template_image_mapped = 0;
+    projects_from_image(image, size);
+    
+    if (builder.errors > 0) {
+        snprintf(message, sizeof(message), "Templates: %d problems, first: %.200s",
+                 builder.errors, builder.first_error);
+        set_status(message, COLOR_ERROR);
+    }
+    free_builder(&builder);
+    
+done:
+    for (i = 0; i < path_count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    stat_record(STAT_TEMPLATES, start);
+}
+
+/* Make room for one more element in a growable array; exits when memory runs out */
+void *grow_array(void *array, int *capacity, int count, size_t size) {
+    void *grown;
+    
+    if (count < *capacity) {
+        return array;
+    }
+    
+    *capacity = *capacity ? *capacity * 2 : 16;
+    while (*capacity <= count) {
+        *capacity *= 2;
+    }
+    grown = realloc(array, *capacity * size);
+    if (grown == NULL) {
+        endwin();
+        fprintf(stderr, "scream: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    return grown;
+}
+
+/*
+ * Template source files: *.conf in each directory of SCREAM_TEMPLATE_PATH, or
+ * in /etc/scream/templates.d and then $XDG_CONFIG_HOME/scream/templates.d.
+ * Files are sorted within a directory; later templates override earlier ones.
+ */
+int template_source_list(char ***paths) {
+    const char *config = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    char user_dir[MAX_PATH_LENGTH] = "";
+    char **dirs;
+    char **list = NULL;
+    int count = 0, capacity = 0;
+    int dir_count, i, j, n;
+    
+    if (config != NULL && *config != '\0') {
+        snprintf(user_dir, sizeof(user_dir), "%s/scream/templates.d", config);
+    } else if (home != NULL && *home != '\0') {
+        snprintf(user_dir, sizeof(user_dir), "%s/.config/scream/templates.d", home);
+    }
+    
+    if (getenv("SCREAM_TEMPLATE_PATH") != NULL) {
+        dirs = split_list(getenv("SCREAM_TEMPLATE_PATH"), "", &dir_count);
+    } else {
+        char fallback[MAX_PATH_LENGTH + 32];
+        
+        snprintf(fallback, sizeof(fallback), "/etc/scream/templates.d:%s", user_dir);
+        dirs = split_list(NULL, fallback, &dir_count);
+    }
+    
+    for (i = 0; dirs != NULL && i < dir_count; i++) {
+        struct dirent **names;
+        
+        n = scandir(dirs[i], &names, NULL, alphasort);
+        for (j = 0; j < n; j++) {
+            size_t len = strlen(names[j]->d_name);
+            
+            if (names[j]->d_name[0] != '.' && len > 5 && strcmp(names[j]->d_name + len - 5, ".conf") == 0) {
+                list = grow_array(list, &capacity, count, sizeof(char *));
+                if (asprintf(&list[count], "%s/%s", dirs[i], names[j]->d_name) >= 0) {
+                    count++;
+                }
+            }
+            free(names[j]);
+        }
+        if (n >= 0) {
+            free(names);
+        }
+        free(dirs[i]);
+    }
+    free(dirs);
+    
+    *paths = list;
+    return count;
+}
+
+/* Append a string to the builder's pool; returns its offset (0 for the empty string) */
+uint32_t builder_string(TemplateBuilder *b, const char *str) {
+    int len = strlen(str) + 1;
+    uint32_t offset;
+    
+    if (b->strings_size > 0 && len == 1) {
+        return 0;
+    }
+    
+    while (b->strings_size + len > b->strings_capacity) {
+        b->strings = grow_array(b->strings, &b->strings_capacity, b->strings_capacity, 1);
+    }
+    
+    offset = b->strings_size;
+    memcpy(b->strings + offset, str, len);
+    b->strings_size += len;
+    
+    return offset;
+}
+
+/*
+ * Split a readiness probe, tcp:PORT, file:PATH or log:FILE:TEXT, copying
+ * the path into path. Returns the READY_* kind, or -1 if it is malformed.
+ */
+int ready_parse(const char *spec, int *port, char *path, size_t len, const char **text) {
+    const char *colon;
+    char *rest;
+    long number;
+    
+    *port = 0;
+    *text = NULL;
+    path[0] = '\0';
+    
+    if (strncmp(spec, "tcp:", 4) == 0) {
+        number = strtol(spec + 4, &rest, 10);
+        if (rest == spec + 4 || *rest != '\0' || number <= 0 || number > 65535) {
+            return -1;
+        }
+        *port = (int)number;
+        return READY_TCP;
+    }
+    
+    if (strncmp(spec, "file:", 5) == 0) {
+        if (spec[5] == '\0' || strlen(spec + 5) >= len) {
+            return -1;
+        }
+        strcpy(path, spec + 5);
+        return READY_FILE;
+    }
+    
+    if (strncmp(spec, "log:", 4) == 0) {
+        colon = strchr(spec + 4, ':');
+        if (colon == NULL || colon == spec + 4 || colon[1] == '\0' || (size_t)(colon - spec - 4) >= len) {
+            return -1;
+        }
+        memcpy(path, spec + 4, colon - spec - 4);
+        path[colon - spec - 4] = '\0';
+        *text = colon + 1;
+        return READY_LOG;
+    }
+    
+    return -1;
+}
+
+/* Count a template file problem, remembering the first one for the status line */
+void builder_error(TemplateBuilder *b, const char *origin, int line, const char *what) {
+    if (b->errors++ == 0) {
+        snprintf(b->first_error, sizeof(b->first_error), "%s:%d: %s", origin, line, what);
+    }
+}
+
+/*
+ * Parse template definitions:
+ *
+ *   [template web-app]
+ *   components = db api          (plain components, shorthand)
+ *   [component frontend]
+ *   command = npm run dev
+ *   directory = ~/src/web
+ *   env = PORT=3000              (repeatable)
+ *   depends = api                (started once these are ready)
+ *   ready = tcp:3000             (or file:PATH, log:FILE:TEXT)
+ *   ready_timeout = 30           (seconds)
+ *
+ * A template defined again replaces the earlier definition.
+ */
+void builder_parse(TemplateBuilder *b, const char *text, const char *origin) {
+    TemplateCacheTemplate *template = NULL;
+    TemplateCacheComponent *component = NULL;
+    char *copy = strdup(text);
+    char *rest = copy;
+    char *line, *key, *value, *end;
+    int line_number = 0;
+    int i;
+    
+    if (copy == NULL) {
+        return;
+    }
+    
+    /* strsep keeps empty lines, so line_number stays in step with the file */
+    while ((line = strsep(&rest, "\n")) != NULL) {
+        line_number++;
+        
+        while (isspace((unsigned char)*line)) {
+            line++;
+        }
+        end = line + strlen(line);
+        while (end > line && isspace((unsigned char)end[-1])) {
+            *--end = '\0';
+        }
+        if (*line == '\0' || *line == '#' || *line == ';') {
+            continue;
+        }
+        
+        if (*line == '[') {
+            if (end[-1] != ']') {
+                builder_error(b, origin, line_number, "unterminated section header");
+                continue;
+            }
+            end[-1] = '\0';
+            line++;
+            
+            if (strncmp(line, "template ", 9) == 0) {
+                value = line + 9;
+                while (isspace((unsigned char)*value)) {
+                    value++;
+                }
+                
+                /* Redefinition: retire the earlier template */
+                for (i = 0; i < b->template_count; i++) {
+                    if (b->templates[i].name != 0 && strcmp(b->strings + b->templates[i].name, value) == 0) {
+                        b->templates[i].name = 0;
+                    }
+                }
+                
+                b->templates = grow_array(b->templates, &b->template_capacity, b->template_count,
+                                          sizeof(TemplateCacheTemplate));
+                template = &b->templates[b->template_count++];
+                template->name = builder_string(b, value);
+                template->first_component = b->component_count;
+                template->component_count = 0;
+                component = NULL;
+            } else if (strncmp(line, "component ", 10) == 0 && template != NULL) {
+                value = line + 10;
+                while (isspace((unsigned char)*value)) {
+                    value++;
+                }
+                
+                b->components = grow_array(b->components, &b->component_capacity, b->component_count,
+                                           sizeof(TemplateCacheComponent));
+                component = &b->components[b->component_count++];
+                memset(component, 0, sizeof(*component));
+                component->name = builder_string(b, value);
+                component->first_env = b->env_count;
+                template->component_count++;
+            } else {
+                builder_error(b, origin, line_number, "unknown section or component outside a template");
+                component = NULL;
+            }
+            continue;
+        }
+        
+        value = strchr(line, '=');
+        if (value == NULL || template == NULL) {
+            builder_error(b, origin, line_number, "expected key = value inside a template");
+            continue;
+        }
+        key = line;
+        end = value;
+        *value++ = '\0';
+        while (end > key && isspace((unsigned char)end[-1])) {
+            *--end = '\0';
+        }
+        while (isspace((unsigned char)*value)) {
+            value++;
+        }
+        
+        if (component == NULL && strcmp(key, "components") == 0) {
+            char *name, *name_save;
+            
+            for (name = strtok_r(value, " \t", &name_save); name != NULL;
+                 name = strtok_r(NULL, " \t", &name_save)) {
+                b->components = grow_array(b->components, &b->component_capacity, b->component_count,
+                                           sizeof(TemplateCacheComponent));
+                component = &b->components[b->component_count++];
+                memset(component, 0, sizeof(*component));
+                component->name = builder_string(b, name);
+                component->first_env = b->env_count;
+                template->component_count++;
+            }
+            component = NULL;
+        } else if (component != NULL && strcmp(key, "command") == 0) {
+            component->command = builder_string(b, value);
+        } else if (component != NULL && strcmp(key, "directory") == 0) {
+            component->directory = builder_string(b, value);
+        } else if (component != NULL && strcmp(key, "env") == 0 && strchr(value, '=') != NULL) {
+            b->env = grow_array(b->env, &b->env_capacity, b->env_count, sizeof(uint32_t));
+            b->env[b->env_count++] = builder_string(b, value);
+            component->env_count++;
+        } else if (component != NULL && strcmp(key, "depends") == 0) {
+            component->depends = builder_string(b, value);
+        } else if (component != NULL && strcmp(key, "ready") == 0) {
+            char path[MAX_PATH_LENGTH];
+            const char *text;
+            int port;
+            
+            if (ready_parse(value, &port, path, sizeof(path), &text) < 0) {
+                builder_error(b, origin, line_number, "ready must be tcp:PORT, file:PATH or log:FILE:TEXT");
+            } else {
+                component->ready = builder_string(b, value);
+            }
+        } else if (component != NULL && strcmp(key, "ready_timeout") == 0) {
+            char *rest;
+            long seconds = strtol(value, &rest, 10);
+            
+            if (rest == value || *rest != '\0' || seconds <= 0 || seconds > 86400) {
+                builder_error(b, origin, line_number, "ready_timeout must be a number of seconds");
+            } else {
+                component->ready_timeout = (uint32_t)seconds;
+            }
+        } else {
+            builder_error(b, origin, line_number, "unknown key");
+        }
+    }
+    
+    free(copy);
+}
+
+/* Serialize the builder into one contiguous cache image */
+void *builder_image(TemplateBuilder *b, size_t *size) {
+    TemplateCacheHeader header;
+    char *image, *p;
+    
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TEMPLATE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = TEMPLATE_CACHE_VERSION;
+    header.defaults_hash = (uint32_t)hash_string(default_templates);
+    header.source_count = b->source_count;
+    header.template_count = b->template_count;
+    header.component_count = b->component_count;
+    header.env_count = b->env_count;
+    header.strings_size = b->strings_size;
+    
+    *size = sizeof(header) +
+            b->source_count * sizeof(TemplateCacheSource) +
+            b->template_count * sizeof(TemplateCacheTemplate) +
+            b->component_count * sizeof(TemplateCacheComponent) +
+            b->env_count * sizeof(uint32_t) +
+            b->strings_size;
+    
+    image = malloc(*size);
+    if (image == NULL) {
+        endwin();
+        fprintf(stderr, "scream: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    p = image;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, b->sources, b->source_count * sizeof(TemplateCacheSource));
+    p += b->source_count * sizeof(TemplateCacheSource);
+    memcpy(p, b->templates, b->template_count * sizeof(TemplateCacheTemplate));
+    p += b->template_count * sizeof(TemplateCacheTemplate);
+    memcpy(p, b->components, b->component_count * sizeof(TemplateCacheComponent));
+    p += b->component_count * sizeof(TemplateCacheComponent);
+    memcpy(p, b->env, b->env_count * sizeof(uint32_t));
+    p += b->env_count * sizeof(uint32_t);
+    memcpy(p, b->strings, b->strings_size);
+    
+    return image;
+}
+
+/* Release a template builder's tables */
+void free_builder(TemplateBuilder *b) {
+    free(b->sources);
+    free(b->templates);
+    free(b->components);
+    free(b->env);
+    free(b->strings);
+}
+
+/* Check a cache image's structure and that its source list matches the files on disk */
+int template_image_valid(const void *image, size_t size, char **paths, int count) {
+    const TemplateCacheHeader *header = image;
+    const TemplateCacheSource *sources;
+    const char *strings;
+    size_t expected;
+    int i;
+    
+    if (size < sizeof(*header) || memcmp(header->magic, TEMPLATE_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != TEMPLATE_CACHE_VERSION ||
+        header->defaults_hash != (uint32_t)hash_string(default_templates) ||
+        header->source_count != (uint32_t)count) {
+        return 0;
+    }
+    
+    expected = sizeof(*header) +
+               (size_t)header->source_count * sizeof(TemplateCacheSource) +
+               (size_t)header->template_count * sizeof(TemplateCacheTemplate) +
+               (size_t)header->component_count * sizeof(TemplateCacheComponent) +
+               (size_t)header->env_count * sizeof(uint32_t) +
+               header->strings_size;
+    if (expected != size || header->strings_size == 0) {
+        return 0;
+    }
+    
+    sources = (const TemplateCacheSource *)(header + 1);
+    strings = (const char *)image + size - header->strings_size;
+    if (strings[header->strings_size - 1] != '\0') {
+        return 0;
+    }
+    
+    for (i = 0; i < count; i++) {
+        struct stat st;
+        
+        if (sources[i].path >= header->strings_size || strcmp(strings + sources[i].path, paths[i]) != 0 ||
+            stat(paths[i], &st) != 0 ||
+            st.st_mtim.tv_sec != sources[i].mtime_sec || st.st_mtim.tv_nsec != sources[i].mtime_nsec ||
+            st.st_size != sources[i].size) {
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+/* Point the projects[] array at the templates in a cache image; returns -1 if it is malformed */
+int projects_from_image(const void *image, size_t size) {
+    const TemplateCacheHeader *header = image;
+    const TemplateCacheTemplate *templates;
+    const TemplateCacheComponent *components;
+    const uint32_t *env;
+    const char *strings = (const char *)image + size - header->strings_size;
+    ProjectComponent *all_components;
+    const char **all_env;
+    Project *list;
+    uint32_t i;
+    int count = 0;
+    
+    templates = (const TemplateCacheTemplate *)((const TemplateCacheSource *)(header + 1) + header->source_count);
+    components = (const TemplateCacheComponent *)(templates + header->template_count);
+    env = (const uint32_t *)(components + header->component_count);
+    
+    list = calloc(header->template_count + 1, sizeof(Project));
+    all_components = calloc(header->component_count + 1, sizeof(ProjectComponent));
+    all_env = calloc(header->env_count + 1, sizeof(char *));
+    if (list == NULL || all_components == NULL || all_env == NULL) {
+        free(list);
+        free(all_components);
+        free(all_env);
+        return -1;
+    }
+    
+    for (i = 0; i < header->env_count; i++) {
+        if (env[i] >= header->strings_size) {
+            goto malformed;
+        }
+        all_env[i] = strings + env[i];
+    }
+    
+    for (i = 0; i < header->component_count; i++) {
+        const TemplateCacheComponent *c = &components[i];
+        
+        if (c->name >= header->strings_size || c->command >= header->strings_size ||
+            c->directory >= header->strings_size || c->depends >= header->strings_size ||
+            c->ready >= header->strings_size ||
+            c->first_env > header->env_count || c->env_count > header->env_count - c->first_env) {
+            goto malformed;
+        }
+        all_components[i].name = strings + c->name;
+        all_components[i].command = c->command ? strings + c->command : NULL;
+        all_components[i].directory = c->directory ? strings + c->directory : NULL;
+        all_components[i].env = all_env + c->first_env;
+        all_components[i].env_count = c->env_count;
+        all_components[i].depends = c->depends ? strings + c->depends : NULL;
+        all_components[i].ready = c->ready ? strings + c->ready : NULL;
+        all_components[i].ready_timeout = (int)c->ready_timeout;
+    }
+    
+    for (i = 0; i < header->template_count; i++) {
+        const TemplateCacheTemplate *t = &templates[i];
+        
+        if (t->name >= header->strings_size || t->first_component > header->component_count ||
+            t->component_count > header->component_count - t->first_component) {
+            goto malformed;
+        }
+        
+        /* Retired by a later definition */
+        if (t->name == 0) {
+            continue;
+        }
+        list[count].name = strings + t->name;
+        list[count].components = all_components + t->first_component;
+        list[count].num_components = t->component_count;
+        count++;
+    }
+    
+    free(projects);
+    free(project_components);
+    free(project_env);
+    projects = list;
+    project_count = count;
+    project_components = all_components;
+    project_env = all_env;
+    return 0;
+    
+malformed:
+    free(list);
+    free(all_components);
+    free(all_env);
+    return -1;
+}
+
+/* Show the cached project list right away; the main loop revalidates it after drawing */
+void load_project_entries() {
+    DirRecord *records;
+    int count;
+    
+    if (!discovery_config_loaded) {
+        discovery_config_load(&discovery_config);
+        discovery_config_loaded = 1;
+    }
+    
+    /* The running walk reads the current records; keep the list as it is until it reports */
+    if (discovery_task.running) {
+        set_status("Project discovery is running...", COLOR_NORMAL);
+        return;
+    }
+    
+    if (discovery_records == NULL) {
+        count = discovery_cache_load(&discovery_config, &records);
+        if (count < 0) {
+            revalidate_project_entries(1);
+            return;
+        }
+        discovery_records = records;
+        discovery_record_count = count;
+    }
+    
+    free_project_entries(project_entries, project_entry_count);
+    project_entry_count = project_entries_from_records(discovery_records, discovery_record_count,
+                                                       &project_entries);
+    set_status("Loaded cached project list, revalidating...", COLOR_NORMAL);
+    project_revalidate_pending = 1;
+}
+
+/* Bring the project list up to date: rescan only changed directories, or everything if full */
+void revalidate_project_entries(int full) {
+    DirRecord *records;
+    int count;
+    
+    if (!discovery_config_loaded) {
+        discovery_config_load(&discovery_config);
+        discovery_config_loaded = 1;
+    }
+    
+    if (!ops_blocking) {
+        discovery_start(full);
+        return;
+    }
+    
+    if (full || discovery_records == NULL) {
+        count = discovery_walk(&discovery_config, NULL, 0, &records);
+    } else {
+        count = discovery_walk(&discovery_config, discovery_records, discovery_record_count, &records);
+    }
+    
+    if (count < 0) {
+        set_status("Project discovery failed", COLOR_ERROR);
+        return;
+    }
+    
+    apply_discovery(records, count, full ? "Rescanned" : "Revalidated");
+}
+
+/* Background walk: signal the main loop through the eventfd when the records are ready */
+void *discovery_thread(void *arg) {
+    DiscoveryTask *task = arg;
+    uint64_t one = 1;
+    
+    task->count = discovery_walk(&discovery_config, task->cached, task->cached_count, &task->records);
+    if (write(task->event_fd, &one, sizeof(one)) < 0) {
+        /* The counter cannot overflow with one write per walk */
+    }
+    return NULL;
+}
+
+/* Start a walk on its own thread so the menus stay usable; the result arrives in discovery_finish */
+void discovery_start(int full) {
+    if (discovery_task.running) {
+        set_status("Project discovery is already running", COLOR_ERROR);
+        return;
+    }
+    if (discovery_task.event_fd < 0) {
+        discovery_task.event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (discovery_task.event_fd < 0) {
+            set_status("Project discovery failed", COLOR_ERROR);
+            return;
+        }
+    }
+    
+    discovery_task.full = full || discovery_records == NULL;
+    discovery_task.cached = discovery_task.full ? NULL : discovery_records;
+    discovery_task.cached_count = discovery_task.full ? 0 : discovery_record_count;
+    discovery_task.records = NULL;
+    discovery_task.count = 0;
+    discovery_task.started = monotonic_us();
+    discovery_cancel = 0;
+    
+    if (pthread_create(&discovery_task.thread, NULL, discovery_thread, &discovery_task) != 0) {
+        set_status("Project discovery failed", COLOR_ERROR);
+        return;
+    }
+    discovery_task.running = 1;
+    set_status(full ? "Rescanning projects..." : "Revalidating projects...", COLOR_NORMAL);
+}
+
+/* Collect a finished background walk; called when its eventfd is readable */
+void discovery_finish() {
+    uint64_t value;
+    
+    if (!discovery_task.running || read(discovery_task.event_fd, &value, sizeof(value)) != sizeof(value)) {
+        return;
+    }
+    pthread_join(discovery_task.thread, NULL);
+    discovery_task.running = 0;
+    
+    if (discovery_cancel) {
+        discovery_cancel = 0;
+        free_dir_records(discovery_task.records, discovery_task.count);
+        set_status("Project discovery cancelled", COLOR_ERROR);
+    } else if (discovery_task.count < 0) {
+        set_status("Project discovery failed", COLOR_ERROR);
+    } else {
+        apply_discovery(discovery_task.records, discovery_task.count,
+                        discovery_task.full ? "Rescanned" : "Revalidated");
+    }
+}
+
+/* Replace the known directories with a new walk result, rebuild the list and save the cache */
+void apply_discovery(DirRecord *records, int count, const char *verb) {
+    char message[MAX_LINE_LENGTH];
+    
+    free_dir_records(discovery_records, discovery_record_count);
+    discovery_records = records;
+    discovery_record_count = count;
+    
+    /* Building the list resolves keys for new projects, so save afterwards */
+    free_project_entries(project_entries, project_entry_count);
+    project_entry_count = project_entries_from_records(records, count, &project_entries);
+    discovery_cache_save(&discovery_config, records, count);
+    
+    if (project_entry_count == 0) {
+        set_status("No projects found", COLOR_ERROR);
+    } else {
+        snprintf(message, sizeof(message), "%s: %d projects in %d directories", verb,
+                 project_entry_count, count);
+        set_status(message, COLOR_SUCCESS);
+    }
+}
+
+/* Split a colon-separated list (or the fallback when unset) into a NULL-terminated array */
+char **split_list(const char *value, const char *fallback, int *count) {
+    char **list;
+    char *copy, *item, *save;
+    int n = 1;
+    const char *p;
+    
+    if (value == NULL || *value == '\0') {
+        value = fallback;
+    }
+    for (p = value; *p; p++) {
+        n += (*p == ':');
+    }
+    
+    list = calloc(n + 1, sizeof(char *));
+    copy = strdup(value);
+    *count = 0;
+    if (list == NULL || copy == NULL) {
+        free(list);
+        free(copy);
+        return NULL;
+    }
+    
+    for (item = strtok_r(copy, ":", &save); item != NULL; item = strtok_r(NULL, ":", &save)) {
+        list[(*count)++] = strdup(item);
+    }
+    free(copy);
+    
+    return list;
+}
+
+/* Read discovery settings from SCREAM_PROJECT_ROOTS/MARKERS/PRUNE/THREADS */
+void discovery_config_load(DiscoveryConfig *config) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *threads = getenv("SCREAM_DISCOVERY_THREADS");
+    
+    config->roots = split_list(getenv("SCREAM_PROJECT_ROOTS"), "..", &config->root_count);
+    config->markers = split_list(getenv("SCREAM_PROJECT_MARKERS"), "CLAUDE.md", &config->marker_count);
+    config->prune = split_list(getenv("SCREAM_PROJECT_PRUNE"),
+                               ".git:.hg:.svn:node_modules:__pycache__:.venv:venv:.tox:"
+                               ".mypy_cache:.cache:target:vendor",
+                               &config->prune_count);
+    
+    config->threads = cpus > 0 && cpus < DEFAULT_DISCOVERY_THREADS ? (int)cpus : DEFAULT_DISCOVERY_THREADS;
+    if (threads != NULL && atoi(threads) > 0) {
+        config->threads = atoi(threads);
+    }
+}
+
+/* Hash of the settings that decide what a walk finds; a cache built with others is stale */
+unsigned long discovery_signature(const DiscoveryConfig *config) {
+    unsigned long hash = 0;
+    int i;
+    
+    /* Roots are hashed by real path: a relative root means something else in another directory */
+    for (i = 0; i < config->root_count; i++) {
+        char *real = realpath(config->roots[i], NULL);
+        
+        hash = hash * 31 + hash_string(real ? real : config->roots[i]);
+        free(real);
+    }
+    hash = hash * 31 + 1;
+    for (i = 0; i < config->marker_count; i++) {
+        hash = hash * 31 + hash_string(config->markers[i]);
+    }
+    hash = hash * 31 + 2;
+    for (i = 0; i < config->prune_count; i++) {
+        hash = hash * 31 + hash_string(config->prune[i]);
+    }
+    
+    return hash;
+}
+
+/*
+ * Derive a session key from a project path relative to its root, the way
+ * list-projects did: path components joined with spaces, lowercased, anything
+ * outside [a-z0-9 ] turned into a space and each run of spaces into one '-'.
+ * A marker directly in a root is keyed by the root's own name.
+ */
+void project_key(const char *relative, const char *directory, char *key, size_t len) {
+    const char *src = relative;
+    size_t out = 0;
+    int in_space = 0;
+    
+    if (*src == '\0') {
+        src = strrchr(directory, '/') ? strrchr(directory, '/') + 1 : directory;
+    }
+    
+    for (; *src && out < len - 1; src++) {
+        char c = tolower((unsigned char)*src);
+        
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+            key[out++] = c;
+            in_space = 0;
+        } else if (!in_space) {
+            key[out++] = '-';
+            in_space = 1;
+        }
+    }
+    key[out] = '\0';
+}
+
+/* Exact name match against a configured list */
+int is_listed(char **list, int count, const char *name) {
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        if (strcmp(list[i], name) == 0) {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/* Add a path to a set (the set does not own it) */
+void path_set_add(PathSet *set, const char *path) {
+    size_t slot = hash_string(path) & set->mask;
+    
+    while (set->slots[slot] != NULL) {
+        slot = (slot + 1) & set->mask;
+    }
+    set->slots[slot] = path;
+}
+
+int path_set_contains(const PathSet *set, const char *path) {
+    size_t slot;
+    
+    if (set->slots == NULL) {
+        return 0;
+    }
+    
+    slot = hash_string(path) & set->mask;
+    while (set->slots[slot] != NULL) {
+        if (strcmp(set->slots[slot], path) == 0) {
+            return 1;
+        }
+        slot = (slot + 1) & set->mask;
+    }
+    
+    return 0;
+}
+
+/* Queue a directory for scanning (caller holds the lock); takes ownership of path */
+void discovery_push(DiscoveryWalk *walk, char *path, int root_len, const DirRecord *cached) {
+    if (walk->queue_count == walk->queue_capacity) {
+        int capacity = walk->queue_capacity ? walk->queue_capacity * 2 : 256;
+        DiscoveryItem *grown = realloc(walk->queue, capacity * sizeof(DiscoveryItem));
+        
+        if (grown == NULL) {
+            free(path);
+            return;
+        }
+        walk->queue = grown;
+        walk->queue_capacity = capacity;
+    }
+    
+    walk->queue[walk->queue_count].path = path;
+    walk->queue[walk->queue_count].root_len = root_len;
+    walk->queue[walk->queue_count].cached = cached;
+    walk->queue_count++;
+}
+
+/* Append the walk result for one directory (caller holds the lock) */
+void discovery_record(DiscoveryWalk *walk, const DiscoveryItem *item, struct timespec mtime, int is_project) {
+    DirRecord *record;
+    
+    if (walk->record_count == walk->record_capacity) {
+        int capacity = walk->record_capacity ? walk->record_capacity * 2 : 256;
+        DirRecord *grown = realloc(walk->records, capacity * sizeof(DirRecord));
+        
+        if (grown == NULL) {
+            return;
+        }
+        walk->records = grown;
+        walk->record_capacity = capacity;
+    }
+    
+    record = &walk->records[walk->record_count++];
+    memset(record, 0, sizeof(*record));
+    record->path = strdup(item->path);
+    record->mtime = mtime;
+    record->root_len = item->root_len;
+    record->is_project = is_project;
+    
+    /* An unchanged project keeps the key and real path resolved last time */
+    if (item->cached != NULL && is_project == item->cached->is_project) {
+        record->key = item->cached->key ? strdup(item->cached->key) : NULL;
+        record->real = item->cached->real ? strdup(item->cached->real) : NULL;
+    }
+}
+
+/*
+ * Scan one directory: note whether it holds a marker file and queue its
+ * subdirectories. A cached directory whose mtime is unchanged has the same
+ * entries as last time, so it is recorded without being read; when it has
+ * changed, only subdirectories the cache does not know yet are queued (the
+ * known ones are already queued for their own revalidation).
+ */
+void discovery_scan(DiscoveryWalk *walk, const DiscoveryItem *item) {
+    const DiscoveryConfig *config = walk->config;
+    char **subdirs = NULL;
+    int subdir_count = 0, subdir_capacity = 0;
+    int is_project = 0;
+    struct dirent *de;
+    struct stat st;
+    DIR *dp;
+    int i;
+    
+    if (item->cached != NULL) {
+        if (stat(item->path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            return;
+        }
+        if (st.st_mtim.tv_sec == item->cached->mtime.tv_sec &&
+            st.st_mtim.tv_nsec == item->cached->mtime.tv_nsec) {
+            pthread_mutex_lock(&walk->lock);
+            discovery_record(walk, item, st.st_mtim, item->cached->is_project);
+            pthread_mutex_unlock(&walk->lock);
+            return;
+        }
+    }
+    
+    dp = opendir(item->path);
+    if (dp == NULL) {
+        return;
+    }
+    if (fstat(dirfd(dp), &st) != 0) {
+        closedir(dp);
+        return;
+    }
+    
+    while ((de = readdir(dp)) != NULL) {
+        int is_dir;
+        
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+        
+        /* Like find, never follow symlinks into other trees */
+        is_dir = (de->d_type == DT_DIR);
+        if (de->d_type == DT_UNKNOWN) {
+            struct stat sub;
+            
+            is_dir = fstatat(dirfd(dp), de->d_name, &sub, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(sub.st_mode);
+        }
+        
+        if (!is_dir) {
+            if (!is_project && is_listed(config->markers, config->marker_count, de->d_name)) {
+                is_project = 1;
+            }
+            continue;
+        }
+        
+        if (is_listed(config->prune, config->prune_count, de->d_name)) {
+            continue;
+        }
+        
+        if (subdir_count == subdir_capacity) {
+            char **grown;
+            
+            subdir_capacity = subdir_capacity ? subdir_capacity * 2 : 16;
+            grown = realloc(subdirs, subdir_capacity * sizeof(char *));
+            if (grown == NULL) {
+                break;
+            }
+            subdirs = grown;
+        }
+        if (asprintf(&subdirs[subdir_count], "%s/%s", item->path, de->d_name) < 0) {
+            continue;
+        }
+        if (path_set_contains(&walk->known, subdirs[subdir_count])) {
+            free(subdirs[subdir_count]);
+            continue;
+        }
+        subdir_count++;
+    }
+    closedir(dp);
+    
+    pthread_mutex_lock(&walk->lock);
+    
+    for (i = 0; i < subdir_count; i++) {
+        discovery_push(walk, subdirs[i], item->root_len, NULL);
+    }
+    if (subdir_count > 0) {
+        pthread_cond_broadcast(&walk->wake);
+    }
+    discovery_record(walk, item, st.st_mtim, is_project);
+    
+    pthread_mutex_unlock(&walk->lock);
+    free(subdirs);
+}
+
+/* Walker thread: scan queued directories until the queue drains and nobody is busy */
+void *discovery_worker(void *arg) {
+    DiscoveryWalk *walk = arg;
+    DiscoveryItem item;
+    
+    pthread_mutex_lock(&walk->lock);
+    while (1) {
+        while (walk->queue_count == 0 && walk->busy > 0) {
+            pthread_cond_wait(&walk->wake, &walk->lock);
+        }
+        if (walk->queue_count == 0) {
+            break;
+        }
+        
+        item = walk->queue[--walk->queue_count];
+        walk->busy++;
+        pthread_mutex_unlock(&walk->lock);
+        
+        /* A cancelled walk drains its queue without reading anything more */
+        if (!discovery_cancel) {
+            discovery_scan(walk, &item);
+        }
+        
+        pthread_mutex_lock(&walk->lock);
+        walk->busy--;
+        free(item.path);
+        if (walk->queue_count == 0 && walk->busy == 0) {
+            pthread_cond_broadcast(&walk->wake);
+        }
+    }
+    pthread_mutex_unlock(&walk->lock);
+    
+    return NULL;
+}
+
+/*
+ * Walk the configured roots in parallel and return a record for every directory
+ * visited. With cached records, each known directory is revalidated by mtime and
+ * only changed directories (and new subtrees under them) are read.
+ */
+int discovery_walk(const DiscoveryConfig *config, const DirRecord *cached, int cached_count, DirRecord **records) {
+    DiscoveryWalk walk;
+    pthread_t *threads;
+    int started = 0;
+    int i;
+    double start = monotonic_us();
+    
+    memset(&walk, 0, sizeof(walk));
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.wake, NULL);
+    walk.config = config;
+    
+    if (cached_count > 0) {
+        size_t nslots = 256;
+        
+        while (nslots < (size_t)cached_count * 2) {
+            nslots *= 2;
+        }
+        walk.known.slots = calloc(nslots, sizeof(char *));
+        walk.known.mask = nslots - 1;
+        for (i = 0; walk.known.slots != NULL && i < cached_count; i++) {
+            path_set_add(&walk.known, cached[i].path);
+            discovery_push(&walk, strdup(cached[i].path), cached[i].root_len, &cached[i]);
+        }
+    }
+    
+    for (i = 0; i < config->root_count; i++) {
+        char *root = strdup(config->roots[i]);
+        size_t len = strlen(root);
+        
+        /* Strip trailing slashes so relative paths start right after the root */
+        while (len > 1 && root[len - 1] == '/') {
+            root[--len] = '\0';
+        }
+        if (path_set_contains(&walk.known, root)) {
+            free(root);
+            continue;
+        }
+        discovery_push(&walk, root, (int)len, NULL);
+    }
+    
+    threads = calloc(config->threads, sizeof(pthread_t));
+    for (i = 0; threads != NULL && i < config->threads; i++) {
+        if (pthread_create(&threads[i], NULL, discovery_worker, &walk) == 0) {
+            started++;
+        }
+    }
+    
+    /* Run the walk on this thread as well; it also covers thread creation failures */
+    discovery_worker(&walk);
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(walk.queue);
+    free(walk.known.slots);
+    pthread_mutex_destroy(&walk.lock);
+    pthread_cond_destroy(&walk.wake);
+    
+    *records = walk.records;
+    stat_record(STAT_DISCOVERY, start);
+    return walk.record_count;
+}
+
+/* Build the sorted, duplicate-free project list from walk records, resolving new keys */
+int project_entries_from_records(DirRecord *records, int count, ProjectEntry **entries) {
+    ProjectEntry *list;
+    int i, n = 0, out;
+    
+    list = calloc(count > 0 ? count : 1, sizeof(ProjectEntry));
+    if (list == NULL) {
+        *entries = NULL;
+        return 0;
+    }
+    
+    for (i = 0; i < count; i++) {
+        DirRecord *record = &records[i];
+        
+        if (!record->is_project) {
+            continue;
+        }
+        
+        if (record->key == NULL) {
+            char key[MAX_NAME_LENGTH];
+            const char *relative = record->path + record->root_len;
+            
+            if (*relative == '/') {
+                relative++;
+            }
+            record->real = realpath(record->path, NULL);
+            if (record->real == NULL) {
+                record->real = strdup(record->path);
+            }
+            project_key(relative, record->real, key, sizeof(key));
+            record->key = strdup(key);
+        }
+        
+        list[n].key = strdup(record->key);
+        list[n].directory = strdup(record->real);
+        n++;
+    }
+    
+    /* Sort and drop duplicates from overlapping roots */
+    if (n > 0) {
+        qsort(list, n, sizeof(ProjectEntry), compare_project_entries);
+    }
+    for (i = 0, out = 0; i < n; i++) {
+        if (out > 0 && strcmp(list[out - 1].directory, list[i].directory) == 0) {
+            free(list[i].key);
+            free(list[i].directory);
+            continue;
+        }
+        list[out++] = list[i];
+    }
+    
+    *entries = list;
+    return out;
+}
+
+/* Order project entries by directory */
+int compare_project_entries(const void *a, const void *b) {
+    return strcmp(((const ProjectEntry *)a)->directory, ((const ProjectEntry *)b)->directory);
+}
+
+/* Release a project entry array */
+void free_project_entries(ProjectEntry *entries, int count) {
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        free(entries[i].key);
+        free(entries[i].directory);
+    }
+    free(entries);
+}
+
+/* Release a directory record array */
+void free_dir_records(DirRecord *records, int count) {
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        free(records[i].path);
+        free(records[i].key);
+        free(records[i].real);
+    }
+    free(records);
+}
+
+/*
+ * Location of a file in the scream directory below an XDG base directory:
+ * $variable, or fallback under $HOME. Creates the directories.
+ */
+int xdg_file_path(const char *variable, const char *fallback, const char *name, char *buf, size_t len) {
+    const char *base = getenv(variable);
+    const char *home = getenv("HOME");
+    char *p;
+    
+    if (base != NULL && *base != '\0') {
+        snprintf(buf, len, "%s", base);
+    } else if (home != NULL && *home != '\0') {
+        snprintf(buf, len, "%s/%s", home, fallback);
+        for (p = buf + strlen(home) + 1; (p = strchr(p, '/')) != NULL; p++) {
+            *p = '\0';
+            mkdir(buf, 0700);
+            *p = '/';
+        }
+    } else {
+        return -1;
+    }
+    
+    mkdir(buf, 0700);
+    strncat(buf, "/scream", len - strlen(buf) - 1);
+    if (mkdir(buf, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    
+    strncat(buf, "/", len - strlen(buf) - 1);
+    strncat(buf, name, len - strlen(buf) - 1);
+    return 0;
+}
+
+/* Location of a file in the cache directory ($XDG_CACHE_HOME/scream) */
+int cache_file_path(const char *name, char *buf, size_t len) {
+    return xdg_file_path("XDG_CACHE_HOME", ".cache", name, buf, len);
+}
+
+/* Location of a file in the state directory ($XDG_STATE_HOME/scream), for data kept across reboots */
+int state_file_path(const char *name, char *buf, size_t len) {
+    return xdg_file_path("XDG_STATE_HOME", ".local/state", name, buf, len);
+}
+
+/*
+ * Load the discovery cache. Format: a "scream-projects 1 <signature>" header,
+ * then one line per directory: "sec nsec root_len is_project\tpath", followed
+ * by "\tkey\treal" for projects. Returns -1 if missing or built with other settings.
+ */
+int discovery_cache_load(const DiscoveryConfig *config, DirRecord **records) {
+    char path[MAX_PATH_LENGTH];
+    char *line = NULL;
+    size_t line_len = 0;
+    unsigned long signature;
+    DirRecord *list = NULL;
+    int count = 0, capacity = 0;
+    FILE *fp;
+    
+    if (cache_file_path("projects.idx", path, sizeof(path)) != 0 || (fp = fopen(path, "r")) == NULL) {
+        return -1;
+    }
+    
+    if (getline(&line, &line_len, fp) < 0 ||
+        sscanf(line, "scream-projects 1 %lu", &signature) != 1 ||
+        signature != discovery_signature(config)) {
+        free(line);
+        fclose(fp);
+        return -1;
+    }
+    
+    while (getline(&line, &line_len, fp) > 0) {
+        DirRecord record;
+        long long sec;
+        long nsec;
+        char *fields, *dir, *key, *real;
+        
+        line[strcspn(line, "\n")] = '\0';
+        memset(&record, 0, sizeof(record));
+        if (sscanf(line, "%lld %ld %d %d", &sec, &nsec, &record.root_len, &record.is_project) != 4 ||
+            (fields = strchr(line, '\t')) == NULL) {
+            continue;
+        }
+        
+        dir = fields + 1;
+        key = strchr(dir, '\t');
+        real = NULL;
+        if (key != NULL) {
+            *key++ = '\0';
+            real = strchr(key, '\t');
+            if (real != NULL) {
+                *real++ = '\0';
+            }
+        }
+        
+        if (count == capacity) {
+            DirRecord *grown;
+            
+            capacity = capacity ? capacity * 2 : 256;
+            grown = realloc(list, capacity * sizeof(DirRecord));
+            if (grown == NULL) {
+                break;
+            }
+            list = grown;
+        }
+        
+        record.path = strdup(dir);
+        record.mtime.tv_sec = (time_t)sec;
+        record.mtime.tv_nsec = nsec;
+        if (record.is_project && key != NULL && real != NULL) {
+            record.key = strdup(key);
+            record.real = strdup(real);
+        }
+        list[count++] = record;
+    }
+    
+    free(line);
+    fclose(fp);
+    
+    *records = list;
+    return count;
+}
+
+/* Write the discovery cache atomically; skipped if a path cannot be stored in the line format */
+void discovery_cache_save(const DiscoveryConfig *config, const DirRecord *records, int count) {
+    char path[MAX_PATH_LENGTH];
+    char tmp[MAX_PATH_LENGTH + 8];
+    FILE *fp;
+    int i;
+    
+    if (cache_file_path("projects.idx", path, sizeof(path)) != 0) {
+        return;
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (strpbrk(records[i].path, "\t\n") != NULL ||
+            (records[i].real != NULL && strpbrk(records[i].real, "\t\n") != NULL)) {
+            unlink(path);
+            return;
+        }
+    }
+    
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        return;
+    }
+    
+    fprintf(fp, "scream-projects 1 %lu\n", discovery_signature(config));
+    for (i = 0; i < count; i++) {
+        fprintf(fp, "%lld %ld %d %d\t%s", (long long)records[i].mtime.tv_sec, (long)records[i].mtime.tv_nsec,
+                records[i].root_len, records[i].is_project, records[i].path);
+        if (records[i].is_project && records[i].key != NULL && records[i].real != NULL) {
+            fprintf(fp, "\t%s\t%s", records[i].key, records[i].real);
+        }
+        fputc('\n', fp);
+    }
+    
+    if (fclose(fp) == 0) {
+        rename(tmp, path);
+    } else {
+        unlink(tmp);
+    }
+}
+
+/* Check if a screen with the given name already exists */
+int screen_exists(const char *name) {
+    /* The inotify watch keeps the table current; refetch only without one */
+    if (watch_fd < 0) {
+        fetch_screens();
+    }
+    
+    return screen_find_by_name(name) >= 0;
+}
+
+/* Start a job through the backend; returns -1 if it could not be started, 1 if it is already done */
+int start_job(Job *job) {
+    return backend->start_job(job);
+}
+
+/*
+ * Start a job's child process; returns -1 if it could not be spawned. A
+ * screen -X command that can go straight over the session socket needs no
+ * child, and returns 1 as done once it is sent.
+ */
+int spawn_job(Job *job) {
+    pid_t pid;
+    
+    if (screen_job_direct(job) == 0) {
+        return 1;
+    }
+    
+    pid = spawn_start(job->argv, job->cwd, job->envp, NULL, &job->err_fd, 0);
+    if (pid < 0) {
+        snprintf(job->result.error, sizeof(job->result.error), "cannot run %s: %s",
+                 job->argv[0], strerror(errno));
+        return -1;
+    }
+    
+    job->pid = pid;
+    job->pidfd = -1;
+#ifdef SYS_pidfd_open
+    if (ops_use_pidfd) {
+        job->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    }
+#endif
+    job->state = JOB_RUNNING;
+    job->started = monotonic_us();
+    return 0;
+}
+
+/* Run all pending jobs through the executor and wait until every one has finished */
+void run_jobs(Job *jobs, int count) {
+    Operation *op = op_new("jobs", 0, NULL);
+    
+    if (op == NULL) {
+        return;
+    }
+    op->jobs = jobs;
+    op->job_count = count;
+    op->waited = 1;
+    op_submit(op);
+    op_wait(op);
+    op_free(op);
+}
+
+/* A new operation with job_count zeroed jobs of its own; NULL when out of memory */
+Operation *op_new(const char *label, int job_count, void (*complete)(Operation *op)) {
+    Operation *op = calloc(1, sizeof(Operation));
+    
+    if (op == NULL) {
+        return NULL;
+    }
+    if (job_count > 0) {
+        op->jobs = calloc(job_count, sizeof(Job));
+        if (op->jobs == NULL) {
+            free(op);
+            return NULL;
+        }
+        op->owns_jobs = 1;
+    }
+    snprintf(op->label, sizeof(op->label), "%s", label);
+    op->job_count = job_count;
+    op->complete = complete;
+    return op;
+}
+
+/* Queue an operation; in the batch modes this also waits for it to finish */
+void op_submit(Operation *op) {
+    int i;
+    
+    ops_init();
+    op->started = monotonic_us();
+    
+    /* Jobs decided before submission (skipped, failed) count as finished */
+    for (i = 0; i < op->job_count; i++) {
+        if (op->jobs[i].state != JOB_PENDING && op->jobs[i].state != JOB_WAITING) {
+            op->finished++;
+        }
+    }
+    
+    operations = grow_array(operations, &operation_capacity, operation_count, sizeof(Operation *));
+    operations[operation_count++] = op;
+    ops_advance();
+    
+    if (ops_blocking && !op->waited) {
+        op->waited = 1;
+        op_wait(op);
+        op_free(op);
+    }
+}
+
+/* Drive the executor until the operation has completed; jobs without a child finish through the watch */
+void op_wait(Operation *op) {
+    struct pollfd fds[MAX_POLL_FDS];
+    int nfds = 0;
+    
+    while (1) {
+        if (nfds > 0 && watch_fd >= 0 && fds[0].fd == watch_fd && (fds[0].revents & POLLIN)) {
+            watch_process();
+        }
+        ops_process();
+        if (op->done) {
+            break;
+        }
+        nfds = 0;
+        if (watch_fd >= 0) {
+            fds[0].fd = watch_fd;
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+            nfds = 1;
+        }
+        nfds += ops_poll_fds(fds + nfds, MAX_POLL_FDS - nfds);
+        poll(fds, nfds, ops_timeout());
+    }
+}
+
+void op_free(Operation *op) {
+    if (op->owns_jobs) {
+        int i;
+        
+        for (i = 0; i < op->job_count; i++) {
+            free_job_resources(&op->jobs[i]);
+        }
+        free(op->jobs);
+    }
+    free(op);
+}
+
+/* Write one byte per SIGCHLD so poll() wakes up to reap */
+void sigchld_handler(int sig) {
+    int saved = errno;
+    char byte = 0;
+    
+    (void)sig;
+    if (write(sigchld_pipe[1], &byte, 1) < 0) {
+        /* The pipe is full, so a wakeup is pending anyway */
+    }
+    errno = saved;
+}
+
+/*
+ * Pick how child exits are noticed: a pidfd per child where the kernel has
+ * pidfd_open (5.3+), otherwise a SIGCHLD handler writing to a self-pipe.
+ */
+void ops_init() {
+    struct sigaction sa;
+    
+    if (ops_use_pidfd >= 0) {
+        return;
+    }
+    
+    ops_use_pidfd = 0;
+#ifdef SYS_pidfd_open
+    {
+        int fd = (int)syscall(SYS_pidfd_open, getpid(), 0);
+        
+        if (fd >= 0) {
+            close(fd);
+            ops_use_pidfd = 1;
+            return;
+        }
+    }
+#endif
+    
+    if (pipe2(sigchld_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        return;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+}
+
+/* Start pending jobs, oldest operation first, while fewer than max_jobs run */
+void ops_schedule() {
+    int i, j, rc;
+    
+    for (i = 0; i < operation_count && running_jobs < max_jobs; i++) {
+        Operation *op = operations[i];
+        
+        for (j = 0; j < op->job_count && running_jobs < max_jobs; j++) {
+            if (op->jobs[j].state != JOB_PENDING) {
+                continue;
+            }
+            rc = start_job(&op->jobs[j]);
+            if (rc > 0) {
+                running_jobs++;
+                job_ended(op, &op->jobs[j]);
+            } else if (rc == 0) {
+                running_jobs++;
+            } else {
+                op->jobs[j].state = JOB_FAILED;
+                op->finished++;
+            }
+        }
+    }
+}
+
+/*
+ * Settle the waiting jobs of an operation: a job whose dependencies are all
+ * done or already existed becomes pending, one whose dependency failed
+ * fails too. When nothing else is left to run, the jobs still waiting wait
+ * on each other and fail as a cycle. Returns how many jobs changed state.
+ */
+int ops_release(Operation *op) {
+    int i, j, changed = 0, waiting = 0, active = 0;
+    
+    for (i = 0; i < op->job_count; i++) {
+        Job *job = &op->jobs[i];
+        int blocked = 0;
+        
+        if (job->state != JOB_WAITING) {
+            continue;
+        }
+        for (j = 0; j < job->depend_count; j++) {
+            const Job *dep = &op->jobs[job->depends[j]];
+            
+            if (dep->state == JOB_FAILED || dep->state == JOB_CANCELLED) {
+                snprintf(job->result.error, sizeof(job->result.error), "%.100s: %.100s %s",
+                         job->component ? job->component->name : job->target, dep->target, dep->state == JOB_FAILED ? "failed" : "was cancelled");
+                job->state = op->cancelled ? JOB_CANCELLED : JOB_FAILED;
+                break;
+            }
+            if (dep->state != JOB_DONE && dep->state != JOB_SKIPPED) {
+                blocked = 1;
+            }
+        }
+        if (job->state != JOB_WAITING) {
+            op->finished++;
+            changed++;
+        } else if (!blocked) {
+            job->state = JOB_PENDING;
+            changed++;
+        }
+    }
+    
+    for (i = 0; i < op->job_count; i++) {
+        if (op->jobs[i].state == JOB_WAITING) {
+            waiting++;
+        } else if (op->jobs[i].state == JOB_PENDING || op->jobs[i].state == JOB_RUNNING ||
+                   op->jobs[i].state == JOB_PROBING) {
+            active++;
+        }
+    }
+    if (changed == 0 && waiting > 0 && active == 0) {
+        for (i = 0; i < op->job_count; i++) {
+            Job *job = &op->jobs[i];
+            
+            if (job->state == JOB_WAITING) {
+                snprintf(job->result.error, sizeof(job->result.error), "%.200s: dependency cycle",
+                         job->component ? job->component->name : job->target);
+                job->state = JOB_FAILED;
+                op->finished++;
+                changed++;
+            }
+        }
+    }
+    
+    return changed;
+}
+
+/* Start what can run, releasing dependents until nothing changes */
+void ops_advance() {
+    int i, changed;
+    
+    do {
+        ops_schedule();
+        changed = 0;
+        for (i = 0; i < operation_count; i++) {
+            changed += ops_release(operations[i]);
+        }
+    } while (changed > 0);
+}
+
+/* Poll the readiness probes of jobs whose command has succeeded */
+void ops_probe() {
+    double now = monotonic_us();
+    int i, j;
+    
+    for (i = 0; i < operation_count; i++) {
+        Operation *op = operations[i];
+        
+        for (j = 0; j < op->job_count; j++) {
+            Job *job = &op->jobs[j];
+            
+            if (job->state != JOB_PROBING) {
+                continue;
+            }
+            if (ready_check(job)) {
+                job->state = JOB_DONE;
+            } else if (now >= job->ready_deadline) {
+                snprintf(job->result.error, sizeof(job->result.error), "%.200s: not ready after %ds",
+                         job->component ? job->component->name : job->target, job->ready_timeout);
+                job->state = JOB_FAILED;
+            } else {
+                continue;
+            }
+            if (job->ready_fd >= 0) {
+                close(job->ready_fd);
+                job->ready_fd = -1;
+            }
+            op->finished++;
+        }
+    }
+}
+
+/*
+ * Start a non-blocking connect to the probe's port on the loopback address
+ * of family, or settle the one in progress. Returns 1 when it connected, 0 while it is
+ * in progress (ready_fd holds the socket) and -1 when it was refused.
+ */
+int ready_connect(Job *job, int family) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    int fd, error = 0;
+    socklen_t len = sizeof(error);
+    
+    if (job->ready_fd >= 0) {
+        struct pollfd pfd;
+        
+        pfd.fd = job->ready_fd;
+        pfd.events = POLLOUT;
+        if (poll(&pfd, 1, 0) == 0) {
+            return 0;
+        }
+        if (getsockopt(job->ready_fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0) {
+            error = errno;
+        }
+        close(job->ready_fd);
+        job->ready_fd = -1;
+        return error == 0 ? 1 : -1;
+    }
+    
+    memset(&addr, 0, sizeof(addr));
+    if (family == AF_INET6) {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+        
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(job->ready_port);
+        in6->sin6_addr = in6addr_loopback;
+        addr_len = sizeof(*in6);
+    } else {
+        struct sockaddr_in *in = (struct sockaddr_in *)&addr;
+        
+        in->sin_family = AF_INET;
+        in->sin_port = htons(job->ready_port);
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr_len = sizeof(*in);
+    }
+    
+    fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, addr_len) == 0) {
+        close(fd);
+        return 1;
+    }
+    if (errno == EINPROGRESS) {
+        job->ready_fd = fd;
+        return 0;
+    }
+    close(fd);
+    return -1;
+}
+
+/*
+ * Check a readiness probe once without blocking: the port accepts a
+ * connection on 127.0.0.1 or ::1, the file exists, or the log has grown
+ * the awaited text since the launch began.
+ */
+int ready_check(Job *job) {
+    switch (job->ready_kind) {
+        case READY_TCP:
+            /* A connect still in progress is settled first, whichever address it went to */
+            if (job->ready_fd >= 0) {
+                return ready_connect(job, 0) > 0;
+            }
+            return ready_connect(job, AF_INET) > 0 || (job->ready_fd < 0 && ready_connect(job, AF_INET6) > 0);
+        case READY_FILE:
+            return access(job->ready_path, F_OK) == 0;
+        case READY_LOG:
+            return ready_check_log(job);
+        default:
+            return 1;
+    }
+}
+
+/*
+ * Search the part of a log written since the last check for the probe's
+ * text. The tail of the previous read is searched again so a match split
+ * across two checks is still found; a log that shrank is read from the start.
+ */
+int ready_check_log(Job *job) {
+    char buf[65536];
+    size_t text_len = strlen(job->ready_text);
+    size_t keep = text_len - 1;
+    struct stat st;
+    off_t pos;
+    ssize_t n;
+    int fd, found = 0;
+    
+    if (text_len >= sizeof(buf)) {
+        return 0;
+    }
+    fd = open(job->ready_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size < job->ready_offset) {
+        job->ready_offset = 0;
+    }
+    
+    pos = job->ready_offset > (off_t)keep ? job->ready_offset - (off_t)keep : 0;
+    while (!found && (n = pread(fd, buf, sizeof(buf), pos)) > 0) {
+        found = memmem(buf, n, job->ready_text, text_len) != NULL;
+        job->ready_offset = pos + n;
+        if ((size_t)n <= keep) {
+            break;
+        }
+        pos += n - (off_t)keep;
+    }
+    close(fd);
+    
+    return found;
+}
+
+/* Add the completion sources of running jobs to a poll set; returns how many */
+int ops_poll_fds(struct pollfd *fds, int max) {
+    int i, j, n = 0;
+    
+    if (sigchld_pipe[0] >= 0 && n < max) {
+        fds[n].fd = sigchld_pipe[0];
+        fds[n].events = POLLIN;
+        n++;
+    }
+    for (i = 0; i < operation_count; i++) {
+        for (j = 0; j < operations[i]->job_count && n < max; j++) {
+            Job *job = &operations[i]->jobs[j];
+            
+            if (job->state == JOB_RUNNING && job->pidfd >= 0) {
+                fds[n].fd = job->pidfd;
+                fds[n].events = POLLIN;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+/*
+ * Milliseconds the loop may sleep: -1 when idle. A job whose exit cannot be
+ * waited on (no pidfd, or more running than fit in a poll set) is polled
+ * every 50ms and readiness probes every READY_POLL_MS; otherwise the
+ * in-flight line refreshes every OPS_REFRESH_MS.
+ */
+int ops_timeout() {
+    int i, j, watched = 0, probing = 0;
+    
+    /* Jobs that ended as they started leave a handler to run right away */
+    for (i = 0; i < operation_count; i++) {
+        if (operations[i]->finished == operations[i]->job_count) {
+            return 0;
+        }
+    }
+    for (i = 0; i < operation_count; i++) {
+        for (j = 0; j < operations[i]->job_count; j++) {
+            Job *job = &operations[i]->jobs[j];
+            
+            if (job->state == JOB_RUNNING && (job->pid <= 0 || job->pidfd >= 0 || sigchld_pipe[0] >= 0)) {
+                watched++;
+            } else if (job->state == JOB_PROBING) {
+                probing = 1;
+            }
+        }
+    }
+    if (running_jobs == 0) {
+        return probing ? READY_POLL_MS : discovery_task.running ? OPS_REFRESH_MS : -1;
+    }
+    return watched < running_jobs || running_jobs > MAX_POLL_FDS / 2 ? 50 :
+           probing ? READY_POLL_MS : OPS_REFRESH_MS;
+}
+
+/* Record a reaped child's result */
+void job_finish(Operation *op, Job *job, int status) {
+    spawn_finish(status, job->err_fd, &job->result);
+    if (job->pidfd >= 0) {
+        close(job->pidfd);
+        job->pidfd = -1;
+    }
+    job_ended(op, job);
+}
+
+/*
+ * Settle a job whose result is in; frees its slot for the next queued job.
+ * A job with a readiness probe keeps its operation open until it passes.
+ */
+void job_ended(Operation *op, Job *job) {
+    stat_record(STAT_SPAWN, job->started);
+    running_jobs--;
+    if (job->result.status == 0 && job->ready_kind != READY_NONE && !op->cancelled) {
+        job->state = JOB_PROBING;
+        job->ready_deadline = monotonic_us() + job->ready_timeout * 1e6;
+        return;
+    }
+    if (job->result.status == 0) {
+        job->state = JOB_DONE;
+    } else {
+        job->state = op->cancelled ? JOB_CANCELLED : JOB_FAILED;
+    }
+    op->finished++;
+}
+
+/*
+ * Reap exited children, start queued jobs in their place and run the
+ * completion handler of every operation that is done. Returns how many
+ * jobs ended, so the caller knows to redraw.
+ */
+int ops_process() {
+    char drain[64];
+    int i, j, status, ended = 0;
+    
+    if (sigchld_pipe[0] >= 0) {
+        while (read(sigchld_pipe[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+    
+    for (i = 0; i < operation_count; i++) {
+        Operation *op = operations[i];
+        
+        for (j = 0; j < op->job_count; j++) {
+            Job *job = &op->jobs[j];
+            pid_t pid;
+            
+            if (job->state != JOB_RUNNING || job->pid <= 0) {
+                continue;
+            }
+            pid = waitpid(job->pid, &status, WNOHANG);
+            if (pid == job->pid) {
+                job_finish(op, job, status);
+                ended++;
+            } else if (pid < 0 && errno == ECHILD) {
+                /* Reaped elsewhere; the exit status is lost */
+                job_finish(op, job, 1 << 8);
+                ended++;
+            }
+        }
+    }
+    
+    ops_probe();
+    ops_advance();
+    
+    /* Completed operations leave the queue before their handler runs */
+    i = 0;
+    while (i < operation_count) {
+        Operation *op = operations[i];
+        
+        if (op->finished < op->job_count) {
+            i++;
+            continue;
+        }
+        memmove(&operations[i], &operations[i + 1], (operation_count - i - 1) * sizeof(Operation *));
+        operation_count--;
+        if (op->complete != NULL) {
+            op->complete(op);
+        }
+        if (op->waited) {
+            op->done = 1;
+        } else {
+            op_free(op);
+        }
+        ended++;
+    }
+    
+    return ended;
+}
+
+/* The queued operation a job belongs to */
+Operation *job_operation(const Job *job) {
+    int i;
+    
+    for (i = 0; i < operation_count; i++) {
+        if (job >= operations[i]->jobs && job < operations[i]->jobs + operations[i]->job_count) {
+            return operations[i];
+        }
+    }
+    return NULL;
+}
+
+/* Whether anything runs in the background */
+int ops_active() {
+    return operation_count > 0 || discovery_task.running;
+}
+
+/* Cancel everything in flight: queued jobs are dropped, running ones get SIGTERM */
+void ops_cancel() {
+    char message[MAX_LINE_LENGTH];
+    int i, j, count = operation_count;
+    
+    for (i = 0; i < operation_count; i++) {
+        Operation *op = operations[i];
+        
+        op->cancelled = 1;
+        for (j = 0; j < op->job_count; j++) {
+            if (op->jobs[j].state == JOB_PENDING || op->jobs[j].state == JOB_WAITING ||
+                op->jobs[j].state == JOB_PROBING) {
+                op->jobs[j].state = JOB_CANCELLED;
+                op->finished++;
+            } else if (op->jobs[j].state == JOB_RUNNING && op->jobs[j].pid > 0) {
+                kill(op->jobs[j].pid, SIGTERM);
+            }
+        }
+    }
+    if (discovery_task.running) {
+        discovery_cancel = 1;
+        count++;
+    }
+    
+    snprintf(message, sizeof(message), "Cancelling %d operation%s", count, count == 1 ? "" : "s");
+    set_status(message, COLOR_ERROR);
+}
+
+/* One line above the status line listing what runs in the background */
+void draw_operations(int height) {
+    char line[MAX_LINE_LENGTH * 2];
+    double now = monotonic_us();
+    int i, len = 0;
+    
+    if (!ops_active()) {
+        return;
+    }
+    
+    for (i = 0; i < operation_count && len < (int)sizeof(line) - MAX_LINE_LENGTH; i++) {
+        Operation *op = operations[i];
+        
+        len += snprintf(line + len, sizeof(line) - len, "%s%s %d/%d", len > 0 ? ", " : "",
+                        op->label, op->finished, op->job_count);
+    }
+    if (discovery_task.running) {
+        len += snprintf(line + len, sizeof(line) - len, "%sproject discovery %.1fs", len > 0 ? ", " : "",
+                        (now - discovery_task.started) / 1e6);
+    }
+    
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(height - 3, 2, "Running: %.*s (Ctrl-X cancels)", COLS - 30 > 0 ? COLS - 30 : 0, line);
+    attroff(COLOR_PAIR(COLOR_HELP));
+}
+
+/* Release what a job owns (its argv strings are borrowed or inline) */
+void free_job_resources(Job *job) {
+    free(job->cwd);
+    free(job->envp);
+    free(job->script);
+    free(job->logfile);
+    free(job->depends);
+    free(job->ready_path);
+    if (job->ready_kind == READY_TCP && job->ready_fd >= 0) {
+        close(job->ready_fd);
+    }
+    job->cwd = NULL;
+    job->envp = NULL;
+    job->script = NULL;
+    job->logfile = NULL;
+    job->depends = NULL;
+    job->ready_path = NULL;
+    job->ready_kind = READY_NONE;
+}
+
+/* Expand a leading ~ to $HOME; returns a malloc'd path */
+char *expand_home(const char *path) {
+    const char *home = getenv("HOME");
+    char *expanded;
+    
+    if (path[0] == '~' && (path[1] == '/' || path[1] == '\0') && home != NULL) {
+        return asprintf(&expanded, "%s%s", home, path + 1) >= 0 ? expanded : NULL;
+    }
+    
+    return strdup(path);
+}
+
+/*
+ * The current environment with a component's KEY=VALUE overrides applied
+ * (component may be NULL) and SCREAM_TEMPLATE set to the template the
+ * session comes from, when there is one. A single block is malloc'd: the
+ * array, followed by the SCREAM_TEMPLATE string.
+ */
+char **build_environment(const ProjectComponent *component, const char *template) {
+    char **envp;
+    char *extra;
+    int env_count = component != NULL ? component->env_count : 0;
+    int count = 0, n = 0;
+    int i, j;
+    
+    while (environ[count] != NULL) {
+        count++;
+    }
+    
+    envp = malloc((count + env_count + 2) * sizeof(char *) +
+                  (template != NULL ? strlen("SCREAM_TEMPLATE=") + strlen(template) + 1 : 0));
+    if (envp == NULL) {
+        return NULL;
+    }
+    
+    for (i = 0; i < count; i++) {
+        size_t key_len = strcspn(environ[i], "=");
+        int overridden = 0;
+        
+        for (j = 0; j < env_count; j++) {
+            if (strncmp(component->env[j], environ[i], key_len + 1) == 0) {
+                overridden = 1;
+                break;
+            }
+        }
+        if (!overridden) {
+            envp[n++] = environ[i];
+        }
+    }
+    for (j = 0; j < env_count; j++) {
+        envp[n++] = (char *)component->env[j];
+    }
+    if (template != NULL) {
+        extra = (char *)(envp + count + env_count + 2);
+        sprintf(extra, "SCREAM_TEMPLATE=%s", template);
+        envp[n++] = extra;
+    }
+    envp[n] = NULL;
+    
+    return envp;
+}
+
+/* Human readable result of a launch job */
+const char *job_state_label(int state) {
+    switch (state) {
+        case JOB_PENDING:
+            return "pending";
+        case JOB_RUNNING:
+            return "starting";
+        case JOB_WAITING:
+            return "waiting for dependencies";
+        case JOB_PROBING:
+            return "waiting until ready";
+        case JOB_SKIPPED:
+            return "already exists";
+        case JOB_DONE:
+            return "created";
+        case JOB_CANCELLED:
+            return "cancelled";
+        default:
+            return "failed";
+    }
+}
+
+/* Toggle the bulk-kill mark on one session */
+void toggle_mark(int index) {
+    screens[index].marked = !screens[index].marked;
+    marked_count += screens[index].marked ? 1 : -1;
+}
+
+/* Mark all detached listed sessions, or all whose name matches a glob pattern */
+void mark_screens(int detached_only, const char *pattern) {
+    char message[MAX_LINE_LENGTH];
+    int added = 0;
+    int row, i;
+    
+    for (row = 0; row < view_rows(); row++) {
+        i = view_screen(row);
+        if (screens[i].marked) {
+            continue;
+        }
+        if (detached_only && screens[i].state == SCREEN_ATTACHED) {
+            continue;
+        }
+        if (pattern != NULL && fnmatch(pattern, screen_name(&screens[i]), 0) != 0) {
+            continue;
+        }
+        
+        screens[i].marked = 1;
+        marked_count++;
+        added++;
+    }
+    
+    snprintf(message, sizeof(message), "Marked %d more sessions (%d marked)", added, marked_count);
+    set_status(message, COLOR_SUCCESS);
+}
+
+/* Unmark every session */
+void clear_marks() {
+    int i;
+    
+    for (i = 0; i < screen_count; i++) {
+        screens[i].marked = 0;
+    }
+    marked_count = 0;
+}
+
+/* Pattern prompt input in the kill menu */
+void handle_pattern_input(int ch) {
+    if (ch == '\n') {
+        pattern_active = 0;
+        curs_set(0);
+        if (pattern_pos > 0) {
+            mark_screens(0, kill_pattern);
+        }
+    } else if (ch == 27) { /* ESC key */
+        pattern_active = 0;
+        curs_set(0);
+    } else if (ch == KEY_BACKSPACE || ch == 127) {
+        if (pattern_pos > 0) {
+            kill_pattern[--pattern_pos] = '\0';
+        }
+    } else if (isprint(ch) && pattern_pos < MAX_NAME_LENGTH - 1) {
+        kill_pattern[pattern_pos++] = ch;
+        kill_pattern[pattern_pos] = '\0';
+    }
+}
+
+/*
+ * Type-ahead filter of the browse and kill lists. Each session caches the
+ * longest prefix of the filter its name matches, so typing a character only
+ * re-tests the sessions still listed, and deleting one just rebuilds the view
+ * from those cached lengths without any string matching.
+ */
+
+/* Does a name match the first len characters of the filter (substring or fuzzy)? */
+int filter_matches(const char *name, int len) {
+    char pattern[MAX_NAME_LENGTH];
+    int i = 0;
+    
+    if (!filter_fuzzy) {
+        memcpy(pattern, filter_text, len);
+        pattern[len] = '\0';
+        return strcasestr(name, pattern) != NULL;
+    }
+    
+    /* Fuzzy: the filter characters appear in order */
+    for (; *name != '\0' && i < len; name++) {
+        if (tolower((unsigned char)*name) == tolower((unsigned char)filter_text[i])) {
+            i++;
+        }
+    }
+    return i == len;
+}
+
+/* Longest prefix of the filter a name matches */
+int filter_evaluate(const char *name) {
+    int len = 0;
+    
+    while (len < filter_len && filter_matches(name, len + 1)) {
+        len++;
+    }
+    return len;
+}
+
+/* Collect the sessions that match the whole filter, in the chosen order */
+void view_rebuild() {
+    int i;
+    
+    if (view_capacity < screen_count + 1) {
+        view_index = grow_array(view_index, &view_capacity, screen_count, sizeof(int));
+    }
+    
+    view_count = 0;
+    for (i = 0; i < screen_count; i++) {
+        if (screens[i].filter_len >= filter_len) {
+            view_index[view_count++] = i;
+        }
+    }
+    if (list_sort != SORT_NONE) {
+        qsort(view_index, view_count, sizeof(int), compare_view_rows);
+    }
+    view_stale = 0;
+}
+
+/* Largest usage value first, then table order */
+int compare_view_rows(const void *a, const void *b) {
+    const Screen *x = &screens[*(const int *)a];
+    const Screen *y = &screens[*(const int *)b];
+    unsigned long vx, vy;
+    
+    switch (list_sort) {
+        case SORT_RSS:
+            vx = x->rss_kb;
+            vy = y->rss_kb;
+            break;
+        case SORT_CPU:
+            vx = x->cpu;
+            vy = y->cpu;
+            break;
+        default:
+            vx = x->procs;
+            vy = y->procs;
+            break;
+    }
+    
+    if (vx != vy) {
+        return vx > vy ? -1 : 1;
+    }
+    return *(const int *)a - *(const int *)b;
+}
+
+/* Reorder the rows, keeping the cursor on screens[index] if it is still listed */
+void view_keep_selection(int index) {
+    int row;
+    
+    view_stale = 1;
+    for (row = 0; row < view_rows(); row++) {
+        if (view_screen(row) == index) {
+            selected_index = row;
+            return;
+        }
+    }
+}
+
+/* Number of rows in the session list */
+int view_rows() {
+    if (filter_len == 0 && list_sort == SORT_NONE) {
+        return screen_count;
+    }
+    if (view_stale) {
+        view_rebuild();
+    }
+    return view_count;
+}
+
+/* screens[] index of a list row */
+int view_screen(int row) {
+    if (filter_len == 0 && list_sort == SORT_NONE) {
+        return row;
+    }
+    if (view_stale) {
+        view_rebuild();
+    }
+    return view_index[row];
+}
+
+/* Append a character, narrowing the current rows */
+void filter_push(int ch) {
+    int row, kept = 0;
+    
+    if ((filter_len == 0 && list_sort == SORT_NONE) || view_stale) {
+        view_rebuild();
+    }
+    filter_text[filter_len++] = ch;
+    filter_text[filter_len] = '\0';
+    
+    for (row = 0; row < view_count; row++) {
+        Screen *screen = &screens[view_index[row]];
+        
+        if (filter_matches(screen_name(screen), filter_len)) {
+            screen->filter_len = filter_len;
+            view_index[kept++] = view_index[row];
+        } else {
+            screen->filter_len = filter_len - 1;
+        }
+    }
+    view_count = kept;
+    selected_index = 0;
+    screen_top = 0;
+}
+
+/* Drop the last character */
+void filter_pop() {
+    int i;
+    
+    filter_text[--filter_len] = '\0';
+    for (i = 0; i < screen_count; i++) {
+        if (screens[i].filter_len > filter_len) {
+            screens[i].filter_len = filter_len;
+        }
+    }
+    view_stale = 1;
+    selected_index = 0;
+    screen_top = 0;
+}
+
+/* Switch between substring and fuzzy matching, which needs one full pass */
+void filter_toggle_fuzzy() {
+    int i;
+    
+    filter_fuzzy = !filter_fuzzy;
+    for (i = 0; i < screen_count; i++) {
+        screens[i].filter_len = filter_evaluate(screen_name(&screens[i]));
+    }
+    view_stale = 1;
+    selected_index = 0;
+    screen_top = 0;
+}
+
+/* Remove the filter and close its prompt */
+void filter_clear() {
+    int i;
+    
+    for (i = 0; i < screen_count; i++) {
+        screens[i].filter_len = 0;
+    }
+    filter_len = 0;
+    filter_text[0] = '\0';
+    if (filter_editing) {
+        filter_editing = 0;
+        curs_set(0);
+    }
+}
+
+/* Filter prompt input; returns 0 for keys it leaves to the list (navigation) */
+int handle_filter_input(int ch) {
+    if (ch == '\n') {
+        filter_editing = 0;
+        curs_set(0);
+    } else if (ch == 27) { /* ESC key */
+        filter_clear();
+    } else if (ch == '\t') {
+        filter_toggle_fuzzy();
+    } else if (ch == KEY_BACKSPACE || ch == 127) {
+        if (filter_len > 0) {
+            filter_pop();
+        }
+    } else if (isprint(ch) && filter_len < MAX_NAME_LENGTH - 1) {
+        filter_push(ch);
+    } else {
+        return 0;
+    }
+    
+    return 1;
+}
+
+/* Filter prompt over the status line while it is open */
+void draw_filter_prompt() {
+    if (!filter_editing) {
+        return;
+    }
+    
+    move(LINES - 2, 0);
+    clrtoeol();
+    attron(COLOR_PAIR(COLOR_HELP));
+    mvprintw(LINES - 2, 2, "Filter (%s, Tab to switch): ", filter_fuzzy ? "fuzzy" : "substring");
+    attroff(COLOR_PAIR(COLOR_HELP));
+    printw("%s", filter_text);
+}
+
+/* Print a name padded to width, with the characters matching the filter highlighted */
+void draw_filtered_name(const char *name, int width) {
+    const char *match = NULL;
+    int j, k = 0;
+    
+    if (filter_len > 0 && !filter_fuzzy) {
+        match = strcasestr(name, filter_text);
+    }
+    
+    for (j = 0; name[j] != '\0'; j++) {
+        int hit = 0;
+        
+        if (match != NULL) {
+            hit = name + j >= match && name + j < match + filter_len;
+        } else if (filter_fuzzy && k < filter_len &&
+                   tolower((unsigned char)name[j]) == tolower((unsigned char)filter_text[k])) {
+            hit = 1;
+            k++;
+        }
+        
+        if (hit) {
+            attron(A_BOLD | A_UNDERLINE);
+        }
+        addch((unsigned char)name[j]);
+        if (hit) {
+            attroff(A_BOLD | A_UNDERLINE);
+        }
+    }
+    for (; j < width; j++) {
+        addch(' ');
+    }
+}
+
+/* Kill every marked session in parallel; the marks are cleared once the kills are queued */
+void kill_marked_screens() {
+    Operation *op;
+    int count = 0;
+    int i;
+    
+    op = op_new("kill", marked_count, kill_complete);
+    if (op == NULL) {
+        set_status("Out of memory", COLOR_ERROR);
+        return;
+    }
+    
+    for (i = 0; i < screen_count && count < marked_count; i++) {
+        if (screens[i].marked) {
+            kill_job_init(&op->jobs[count++], screen_id(&screens[i]));
+        }
+    }
+    op->job_count = count;
+    clear_marks();
+    
+    op_submit(op);
+}
+
+/* Create screen sessions for a project template, launching components concurrently */
+void create_project_screens(int project_index) {
+    Operation *op;
+    Project *project;
+    int i;
+    
+    if (project_index < 0 || project_index >= project_count) {
+        set_status("Invalid project index", COLOR_ERROR);
+        return;
+    }
+    project = &projects[project_index];
+    
+    /* The per-component results in launch_jobs belong to the running launch */
+    for (i = 0; i < operation_count; i++) {
+        if (operations[i]->complete == launch_complete) {
+            set_status("A template launch is already running", COLOR_ERROR);
+            return;
+        }
+    }
+    
+    for (i = 0; i < launch_job_count; i++) {
+        free_job_resources(&launch_jobs[i]);
+    }
+    free(launch_jobs);
+    launch_jobs = calloc(project->num_components, sizeof(Job));
+    if (launch_jobs == NULL) {
+        set_status("Out of memory", COLOR_ERROR);
+        return;
+    }
+    launch_job_count = project->num_components;
+    launch_project = project_index;
+    
+    /* Without the inotify watch, refresh once rather than per component */
+    if (watch_fd < 0) {
+        fetch_screens();
+    }
+    
+    for (i = 0; i < project->num_components; i++) {
+        const ProjectComponent *component = &project->components[i];
+        Job *job = &launch_jobs[i];
+        char name[MAX_LINE_LENGTH];
+        struct stat st;
+        
+        snprintf(name, sizeof(name), "%s_%s", project->name, component->name);
+        create_job_init(job, name);
+        job->component = component;
+        job->state = screen_find_by_name(job->target) >= 0 ? JOB_SKIPPED : JOB_PENDING;
+        if (job->state == JOB_SKIPPED) {
+            continue;
+        }
+        
+        /* Run the command, then leave a shell behind so the session stays open */
+        if (component->command != NULL && asprintf(&job->script, "%s" SHELL_AFTER, component->command) >= 0) {
+            create_job_script(job);
+        }
+        
+        if (component->directory != NULL) {
+            job->cwd = expand_home(component->directory);
+            if (job->cwd == NULL || stat(job->cwd, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                snprintf(job->result.error, sizeof(job->result.error), "%.64s: no such directory %.150s",
+                         component->name, job->cwd ? job->cwd : component->directory);
+                job->state = JOB_FAILED;
+                continue;
+            }
+        }
+        
+        /* SCREAM_TEMPLATE lets a snapshot tell where the session came from */
+        job->envp = build_environment(component, project->name);
+    }
+    launch_plan(project, launch_jobs);
+    
+    op = op_new("launch", 0, launch_complete);
+    if (op == NULL) {
+        set_status("Out of memory", COLOR_ERROR);
+        return;
+    }
+    op->jobs = launch_jobs;
+    op->job_count = launch_job_count;
+    snprintf(op->label, sizeof(op->label), "launch %.64s", project->name);
+    op_submit(op);
+}
+
+/*
+ * Wire up the dependencies and readiness probes of a template's launch
+ * jobs. A job that depends on others waits for them; everything else
+ * starts right away. Probe paths are relative to the component's directory.
+ */
+void launch_plan(const Project *project, Job *jobs) {
+    char path[MAX_PATH_LENGTH];
+    int i, j;
+    
+    for (i = 0; i < project->num_components; i++) {
+        const ProjectComponent *component = &project->components[i];
+        Job *job = &jobs[i];
+        char *copy, *name, *save;
+        struct stat st;
+        
+        if (job->state != JOB_PENDING) {
+            continue;
+        }
+        
+        if (component->depends != NULL && (copy = strdup(component->depends)) != NULL) {
+            for (name = strtok_r(copy, " \t,", &save); name != NULL && job->state == JOB_PENDING;
+                 name = strtok_r(NULL, " \t,", &save)) {
+                for (j = 0; j < project->num_components; j++) {
+                    if (strcmp(project->components[j].name, name) == 0) {
+                        break;
+                    }
+                }
+                if (j == project->num_components || j == i) {
+                    snprintf(job->result.error, sizeof(job->result.error), "%.64s: %s %.64s",
+                             component->name, j == i ? "depends on itself:" : "depends on unknown component", name);
+                    job->state = JOB_FAILED;
+                    break;
+                }
+                job->depends = realloc(job->depends, (job->depend_count + 1) * sizeof(int));
+                if (job->depends == NULL) {
+                    job->depend_count = 0;
+                    job->state = JOB_FAILED;
+                    break;
+                }
+                job->depends[job->depend_count++] = j;
+            }
+            free(copy);
+            if (job->state != JOB_PENDING) {
+                continue;
+            }
+            if (job->depend_count > 0) {
+                job->state = JOB_WAITING;
+            }
+        }
+        
+        if (component->ready != NULL) {
+            job->ready_kind = ready_parse(component->ready, &job->ready_port, path, sizeof(path), &job->ready_text);
+            if (job->ready_kind < 0) {
+                job->ready_kind = READY_NONE;
+                continue;
+            }
+            job->ready_fd = -1;
+            job->ready_timeout = component->ready_timeout > 0 ? component->ready_timeout : DEFAULT_READY_TIMEOUT;
+            if (job->ready_kind != READY_TCP) {
+                if (path[0] == '~' || path[0] == '/' || job->cwd == NULL) {
+                    job->ready_path = expand_home(path);
+                } else if (asprintf(&job->ready_path, "%s/%s", job->cwd, path) < 0) {
+                    job->ready_path = NULL;
+                }
+                if (job->ready_path == NULL) {
+                    job->ready_kind = READY_NONE;
+                    continue;
+                }
+            }
+            
+            /* Only lines logged by this launch count */
+            if (job->ready_kind == READY_LOG && stat(job->ready_path, &st) == 0) {
+                job->ready_offset = st.st_size;
+            }
+        }
+    }
+}
+
+/* Count the outcome of a template launch and surface the first failure */
+void launch_complete(Operation *op) {
+    char message[MAX_LINE_LENGTH];
+    int created = 0, existing = 0, failed = 0;
+    int i;
+    
+    for (i = 0; i < launch_job_count; i++) {
+        if (launch_jobs[i].state == JOB_DONE) {
+            created++;
+        } else if (launch_jobs[i].state == JOB_SKIPPED) {
+            existing++;
+        } else {
+            failed++;
+        }
+    }
+    
+    if (watch_fd < 0) {
+        fetch_screens();
+    }
+    
+    snprintf(message, sizeof(message), "%.64s: %d created, %d already exist, %d failed",
+             projects[launch_project].name, created, existing, failed);
+    if (op->cancelled) {
+        strncat(message, " (cancelled)", sizeof(message) - strlen(message) - 1);
+    }
     
-    /* If no projects found */
-    if (project_count == 0) {
-        attron(COLOR_PAIR(COLOR_ERROR));
-        mvprintw(start_y + 1, 2, "No project templates found.");
-        attroff(COLOR_PAIR(COLOR_ERROR));
+    /* Surface the first failure's stderr */
+    for (i = 0; i < launch_job_count; i++) {
+        if (launch_jobs[i].state == JOB_FAILED && launch_jobs[i].result.error[0]) {
+            size_t len = strlen(message);
+            snprintf(message + len, sizeof(message) - len, " (%.200s)", launch_jobs[i].result.error);
+            break;
+        }
+    }
+    set_status(message, failed > 0 ? COLOR_ERROR : COLOR_SUCCESS);
+    stat_record(STAT_LAUNCH, op->started);
+}
+
+/* Create a screen for a project entry */
+void create_project_entry_screens(int entry_index) {
+    char screen_name[MAX_NAME_LENGTH];
+    
+    if (entry_index < 0 || entry_index >= project_entry_count) {
+        set_status("Invalid project entry index", COLOR_ERROR);
+        return;
+    }
+    
+    /* Use the KEY as the screen name */
+    strncpy(screen_name, project_entries[entry_index].key, MAX_NAME_LENGTH - 1);
+    screen_name[MAX_NAME_LENGTH - 1] = '\0';
+    
+    /* Check if a screen with this name already exists */
+    if (screen_exists(screen_name)) {
+        set_status("Screen with this name already exists", COLOR_ERROR);
+        return;
+    }
+    
+    /* Create the screen with the KEY as the name; the outcome is reported when it finishes */
+    create_screen(screen_name);
+}
+
+/*
+ * Batch command line interface. Subcommands share the session table, job
+ * runner and template loader with the menus but never initialize curses:
+ * results go to stdout, problems to stderr, and the exit status is 0 on
+ * success, 1 if any operation failed and 2 for usage errors.
+ */
+int cli_main(int argc, char *argv[]) {
+    const char *command = argv[1];
+    
+    if (strcmp(command, "list") == 0 || strcmp(command, "ls") == 0) {
+        return cli_list(argc - 1, argv + 1);
+    } else if (strcmp(command, "create") == 0) {
+        return cli_create(argc - 1, argv + 1);
+    } else if (strcmp(command, "kill") == 0) {
+        return cli_kill(argc - 1, argv + 1);
+    } else if (strcmp(command, "project") == 0) {
+        return cli_project(argc - 1, argv + 1);
+    } else if (strcmp(command, "send") == 0) {
+        return cli_send(argc - 1, argv + 1);
+    } else if (strcmp(command, "snapshot") == 0) {
+        return cli_snapshot(argc - 1, argv + 1);
+    } else if (strcmp(command, "restore") == 0) {
+        return cli_restore(argc - 1, argv + 1);
+    } else if (strcmp(command, "help") == 0 || strcmp(command, "--help") == 0 || strcmp(command, "-h") == 0) {
+        cli_usage(stdout);
+        return EXIT_SUCCESS;
+    }
+    
+    fprintf(stderr, "scream: unknown command '%s'\n", command);
+    cli_usage(stderr);
+    return EXIT_USAGE;
+}
+
+/* Subcommand summary */
+void cli_usage(FILE *fp) {
+    fprintf(fp,
+            "usage: scream                          interactive menus\n"
+            "       scream list [--json]            list sessions\n"
+            "       scream create NAME...           create detached sessions\n"
+            "       scream kill ID|NAME...          kill sessions by id, pid or name\n"
+            "       scream kill --match PATTERN     kill sessions whose name matches a glob\n"
+            "       scream project list             list project templates\n"
+            "       scream project up TEMPLATE      create a template's sessions\n"
+            "       scream send ID|NAME [-p WINDOW] [-Q] COMMAND [ARG...]\n"
+            "                                       run a screen command (-Q: a query) in a session\n"
+            "       scream snapshot [FILE]          record every session, its windows and commands\n"
+            "       scream restore [FILE]           recreate the sessions of a snapshot\n"
+            "       scream --daemon                 serve the session list on a Unix socket\n");
+}
+
+/* Write a JSON string literal */
+void json_string(FILE *fp, const char *str) {
+    const unsigned char *p;
+    
+    fputc('"', fp);
+    for (p = (const unsigned char *)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(fp, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(fp, "\\u%04x", *p);
+        } else {
+            fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/* scream list [--json] */
+int cli_list(int argc, char *argv[]) {
+    char created[32];
+    int json = 0;
+    int i;
+    
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else {
+            fprintf(stderr, "scream list: unexpected argument '%s'\n", argv[i]);
+            return EXIT_USAGE;
+        }
+    }
+    
+    cli_fetch_screens();
+    
+    if (!json) {
+        for (i = 0; i < screen_count; i++) {
+            screen_format_time(&screens[i], created, sizeof(created));
+            printf("%s\t%s\t%s\n", screen_id(&screens[i]), screen_state_names[screens[i].state], created);
+        }
+        return EXIT_SUCCESS;
+    }
+    
+    fputc('[', stdout);
+    for (i = 0; i < screen_count; i++) {
+        screen_format_time(&screens[i], created, sizeof(created));
+        printf("%s\n  {\"id\": ", i > 0 ? "," : "");
+        json_string(stdout, screen_id(&screens[i]));
+        printf(", \"pid\": %d, \"name\": ", (int)screens[i].pid);
+        json_string(stdout, screen_name(&screens[i]));
+        printf(", \"attached\": %s, \"created\": ", screens[i].state == SCREEN_ATTACHED ? "true" : "false");
+        json_string(stdout, created);
+        fputc('}', stdout);
+    }
+    printf("%s]\n", screen_count > 0 ? "\n" : "");
+    
+    return EXIT_SUCCESS;
+}
+
+/* scream create NAME... -- existing sessions are left alone and not an error */
+int cli_create(int argc, char *argv[]) {
+    Job *jobs;
+    int failed = 0;
+    int i, j;
+    
+    if (argc < 2) {
+        fprintf(stderr, "scream create: no session names given\n");
+        return EXIT_USAGE;
+    }
+    
+    jobs = calloc(argc - 1, sizeof(Job));
+    if (jobs == NULL) {
+        fprintf(stderr, "scream: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    
+    fetch_screens();
+    for (i = 1; i < argc; i++) {
+        Job *job = &jobs[i - 1];
+        
+        create_job_init(job, argv[i]);
+        job->state = screen_find_by_name(job->target) >= 0 ? JOB_SKIPPED : JOB_PENDING;
+        for (j = 1; j < i && job->state == JOB_PENDING; j++) {
+            if (strcmp(argv[j], argv[i]) == 0) {
+                job->state = JOB_SKIPPED;
+            }
+        }
+    }
+    
+    run_jobs(jobs, argc - 1);
+    
+    for (i = 0; i < argc - 1; i++) {
+        if (jobs[i].state == JOB_FAILED) {
+            fprintf(stderr, "scream create: %s: %s\n", jobs[i].target,
+                    jobs[i].result.error[0] ? jobs[i].result.error : "failed");
+            failed++;
+        } else {
+            printf("%s\t%s\n", jobs[i].target, job_state_label(jobs[i].state));
+        }
+    }
+    free(jobs);
+    
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* scream kill ID|NAME... or scream kill --match PATTERN -- fails when nothing matched */
+int cli_kill(int argc, char *argv[]) {
+    int missing = 0;
+    int i, found;
+    
+    if (argc < 2 || (strcmp(argv[1], "--match") == 0 && argc != 3)) {
+        fprintf(stderr, "scream kill: expected session ids or names, or --match PATTERN\n");
+        return EXIT_USAGE;
+    }
+    
+    fetch_screens();
+    
+    if (strcmp(argv[1], "--match") == 0) {
+        mark_screens(0, argv[2]);
     } else {
-        /* Draw project list */
-        for (i = 0; i < project_count; i++) {
-            if (i >= height - start_y - 3) {
-                break; /* Don't draw beyond window height */
+        for (i = 1; i < argc; i++) {
+            found = screen_lookup(argv[i]);
+            if (found < 0) {
+                fprintf(stderr, "scream kill: no session '%s'\n", argv[i]);
+                missing++;
+            } else if (!screens[found].marked) {
+                toggle_mark(found);
             }
+        }
+    }
+    
+    if (marked_count == 0) {
+        fprintf(stderr, "scream kill: no matching sessions\n");
+        return EXIT_FAILURE;
+    }
+    
+    kill_marked_screens();
+    fprintf(status_type == COLOR_ERROR ? stderr : stdout, "%s\n", status_message);
+    
+    return status_type == COLOR_ERROR || missing > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * scream send ID|NAME [-p WINDOW] [-Q] COMMAND [ARG...]: screen -X, or with
+ * -Q screen -Q, sent over the session socket; runs screen when that fails.
+ */
+int cli_send(int argc, char *argv[]) {
+    const char *window = NULL;
+    char **command;
+    SpawnResult result;
+    WindowCache cache;
+    int query = 0, i = 2, n = 0, found, rc = -1;
+    
+    while (i < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            window = argv[i + 1];
+            i += 2;
+        } else if (strcmp(argv[i], "-Q") == 0) {
+            query = 1;
+            i++;
+        } else {
+            break;
+        }
+    }
+    if (argc < 2 || i >= argc) {
+        fprintf(stderr, "scream send: expected a session and a screen command\n");
+        return EXIT_USAGE;
+    }
+    if (backend != &screen_backend) {
+        fprintf(stderr, "scream send: screen commands need the screen backend\n");
+        return EXIT_USAGE;
+    }
+    
+    fetch_screens();
+    found = screen_lookup(argv[1]);
+    if (found < 0) {
+        fprintf(stderr, "scream send: no session '%s'\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    
+    if (!query && screen_msg_send(screen_id(&screens[found]), SCREEN_MSG_COMMAND, window, argv + i, NULL) == 0) {
+        return EXIT_SUCCESS;
+    }
+    
+    memset(&cache, 0, sizeof(cache));
+    cache.pid = screens[found].pid;
+    if (query && screen_query_send(&cache, screen_id(&screens[found]), window, argv + i) == 0) {
+        double deadline = monotonic_us() + WINDOW_QUERY_TIMEOUT_MS * 1000.0;
+        double now;
+        
+        while ((rc = window_query_read(&cache)) == 0 && (now = monotonic_us()) < deadline) {
+            struct pollfd pfd;
             
-            if (i == selected_project) {
-                attron(COLOR_PAIR(COLOR_SELECTED));
-                mvprintw(start_y + i, 2, "%-5d %s", i + 1, projects[i].name);
-                attroff(COLOR_PAIR(COLOR_SELECTED));
-            } else {
-                attron(COLOR_PAIR(COLOR_NORMAL));
-                mvprintw(start_y + i, 2, "%-5d %s", i + 1, projects[i].name);
-                attroff(COLOR_PAIR(COLOR_NORMAL));
+            pfd.fd = cache.out_fd >= 0 ? cache.out_fd : cache.listen_fd;
+            pfd.events = POLLIN;
+            poll(&pfd, 1, (int)((deadline - now) / 1000) + 1);
+        }
+        screen_query_close(&cache);
+        
+        if (rc > 0) {
+            fwrite(cache.output, 1, cache.output_len, stdout);
+            if (cache.output_len > 0 && cache.output[cache.output_len - 1] != '\n') {
+                putchar('\n');
             }
+        } else {
+            fprintf(stderr, "scream send: no reply from '%s'\n", screen_id(&screens[found]));
+        }
+        free(cache.output);
+        return rc > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    /* The socket is out of reach (or SCREAM_SCREEN_DIRECT=0): let screen deliver it */
+    command = calloc(argc + 6, sizeof(char *));
+    if (command == NULL) {
+        fprintf(stderr, "scream: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    command[n++] = "screen";
+    command[n++] = "-S";
+    command[n++] = (char *)screen_id(&screens[found]);
+    if (window != NULL) {
+        command[n++] = "-p";
+        command[n++] = (char *)window;
+    }
+    command[n++] = query ? "-Q" : "-X";
+    for (; i < argc; i++) {
+        command[n++] = argv[i];
+    }
+    
+    spawn_command(command, 1, &result);
+    free(command);
+    if (result.status != 0) {
+        fprintf(stderr, "scream send: screen failed%s%s\n", result.error[0] ? ": " : "", result.error);
+    }
+    return result.status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Whether a program (argv[0], "-bash" for a login shell) is an interactive shell */
+int is_shell(const char *argv0) {
+    static const char *shells[] = { "sh", "bash", "zsh", "fish", "dash", "ksh", "mksh", "tcsh", "csh" };
+    const char *user = getenv("SHELL");
+    const char *base = strrchr(argv0, '/');
+    size_t i;
+    
+    base = base != NULL ? base + 1 : argv0;
+    if (*base == '-') {
+        base++;
+    }
+    if (user != NULL && strrchr(user, '/') != NULL && strcmp(base, strrchr(user, '/') + 1) == 0) {
+        return 1;
+    }
+    for (i = 0; i < sizeof(shells) / sizeof(shells[0]); i++) {
+        if (strcmp(base, shells[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Write a word for sh, in single quotes unless it is plainly safe */
+void fput_word(FILE *fp, const char *word) {
+    if (*word != '\0' && strspn(word, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-./:=@%+,") == strlen(word)) {
+        fputs(word, fp);
+        return;
+    }
+    fputc('\'', fp);
+    for (; *word != '\0'; word++) {
+        if (*word == '\'') {
+            fputs("'\\''", fp);
+        } else {
+            fputc(*word, fp);
+        }
+    }
+    fputc('\'', fp);
+}
+
+/* Write a snapshot field with tabs, newlines and backslashes escaped */
+void fput_field(FILE *fp, const char *text) {
+    for (; text != NULL && *text != '\0'; text++) {
+        if (*text == '\t') {
+            fputs("\\t", fp);
+        } else if (*text == '\n') {
+            fputs("\\n", fp);
+        } else if (*text == '\\') {
+            fputs("\\\\", fp);
+        } else {
+            fputc(*text, fp);
+        }
+    }
+}
+
+/* Undo fput_field in place */
+void unescape_field(char *text) {
+    char *out = text;
+    
+    for (; *text != '\0'; text++) {
+        if (*text == '\\' && text[1] != '\0') {
+            text++;
+            *out++ = *text == 't' ? '\t' : *text == 'n' ? '\n' : *text;
+        } else {
+            *out++ = *text;
+        }
+    }
+    *out = '\0';
+}
+
+int compare_snapshot_windows(const void *a, const void *b) {
+    return ((const SnapshotWindow *)a)->number - ((const SnapshotWindow *)b)->number;
+}
+
+/*
+ * What to run again in a window: the command a launch or restore started
+ * (sh -c 'COMMAND; exec $SHELL'), a shell's foreground job, or the window's
+ * own program when that is not a shell. Empty for an idle shell.
+ */
+char *snapshot_command(const ProcEntry *entry) {
+    char cmdline[MAX_PATH_LENGTH];
+    char *args[3], *command = NULL, *p;
+    size_t size = 0, tail = strlen(SHELL_AFTER);
+    ssize_t n = proc_read(entry->pid, "cmdline", cmdline, sizeof(cmdline));
+    FILE *fp;
+    int argc = 0;
+    
+    if (n <= 0) {
+        return strdup("");
+    }
+    for (p = cmdline; p < cmdline + n && argc < 3; p += strlen(p) + 1) {
+        args[argc++] = p;
+    }
+    if (argc == 3 && is_shell(args[0]) && strcmp(args[1], "-c") == 0 &&
+        strlen(args[2]) > tail && strcmp(args[2] + strlen(args[2]) - tail, SHELL_AFTER) == 0) {
+        return strndup(args[2], strlen(args[2]) - tail);
+    }
+    
+    if (entry->tpgid > 0 && entry->tpgid != entry->pid) {
+        n = proc_read(entry->tpgid, "cmdline", cmdline, sizeof(cmdline));
+    } else if (is_shell(cmdline)) {
+        return strdup("");
+    }
+    
+    fp = open_memstream(&command, &size);
+    if (fp == NULL) {
+        return NULL;
+    }
+    for (p = cmdline; n > 0 && p < cmdline + n; p += strlen(p) + 1) {
+        if (p > cmdline) {
+            fputc(' ', fp);
+        }
+        fput_word(fp, p);
+    }
+    fclose(fp);
+    return command;
+}
+
+/* Windows of a session from the last /proc sweep, sorted by number; returns how many */
+int snapshot_windows(pid_t server, SnapshotWindow **windows, int *capacity) {
+    char cwd[MAX_PATH_LENGTH];
+    char path[64];
+    int i, number, count = 0;
+    
+    for (i = 0; i < proc_count; i++) {
+        SnapshotWindow *window;
+        ssize_t n;
+        
+        if (proc_entries[i].ppid != server || (number = proc_window_number(proc_entries[i].pid)) < 0) {
+            continue;
         }
         
-        /* Draw selected project details */
-        if (project_count > 0) {
-            int detail_y = start_y + project_count + 2;
+        *windows = grow_array(*windows, capacity, count, sizeof(SnapshotWindow));
+        window = &(*windows)[count++];
+        window->number = number;
+        snprintf(path, sizeof(path), "/proc/%d/cwd", (int)proc_entries[i].pid);
+        n = readlink(path, cwd, sizeof(cwd) - 1);
+        cwd[n > 0 ? n : 0] = '\0';
+        window->cwd = strdup(cwd);
+        window->command = snapshot_command(&proc_entries[i]);
+    }
+    
+    qsort(*windows, count, sizeof(SnapshotWindow), compare_snapshot_windows);
+    return count;
+}
+
+void free_snapshot_sessions(SnapshotSession *sessions, int count) {
+    int i, j;
+    
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < sessions[i].window_count; j++) {
+            free(sessions[i].windows[j].cwd);
+            free(sessions[i].windows[j].command);
+        }
+        free(sessions[i].windows);
+        free(sessions[i].name);
+        free(sessions[i].template);
+    }
+    free(sessions);
+}
+
+/*
+ * Record every live session: a "scream-snapshot 1" header, then for each
+ * session "S<TAB>name<TAB>template" followed by one
+ * "W<TAB>number<TAB>cwd<TAB>command" line per window. Returns how many
+ * sessions were written.
+ */
+int snapshot_write(FILE *fp) {
+    char template[MAX_LINE_LENGTH];
+    SnapshotWindow *windows = NULL;
+    int capacity = 0, written = 0;
+    int i, j, count;
+    
+    proc_scan();
+    fprintf(fp, "scream-snapshot %d\n", SNAPSHOT_VERSION);
+    
+    for (i = 0; i < screen_count; i++) {
+        if (screens[i].state == SCREEN_DEAD) {
+            continue;
+        }
+        if (proc_environ_value(screens[i].pid, "SCREAM_TEMPLATE", template, sizeof(template)) != 0) {
+            template[0] = '\0';
+        }
+        fputs("S\t", fp);
+        fput_field(fp, screen_name(&screens[i]));
+        fputc('\t', fp);
+        fput_field(fp, template);
+        fputc('\n', fp);
+        
+        count = snapshot_windows(screens[i].pid, &windows, &capacity);
+        for (j = 0; j < count; j++) {
+            fprintf(fp, "W\t%d\t", windows[j].number);
+            fput_field(fp, windows[j].cwd);
+            fputc('\t', fp);
+            fput_field(fp, windows[j].command);
+            fputc('\n', fp);
+            free(windows[j].cwd);
+            free(windows[j].command);
+        }
+        written++;
+    }
+    
+    free(windows);
+    return written;
+}
+
+/* Read a snapshot; returns the number of sessions, or -1 if it is not one this version reads */
+int snapshot_read(FILE *fp, SnapshotSession **sessions) {
+    char *line = NULL, *fields[4];
+    size_t size = 0;
+    ssize_t len;
+    int capacity = 0, count = 0, version = 0;
+    int i, n;
+    
+    *sessions = NULL;
+    if (getline(&line, &size, fp) < 0 || sscanf(line, "scream-snapshot %d", &version) != 1 ||
+        version != SNAPSHOT_VERSION) {
+        free(line);
+        return -1;
+    }
+    
+    while ((len = getline(&line, &size, fp)) >= 0) {
+        char *p = line;
+        
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        for (n = 0; n < 4 && p != NULL; n++) {
+            fields[n] = strsep(&p, "\t");
+            unescape_field(fields[n]);
+        }
+        
+        if (strcmp(fields[0], "S") == 0 && n >= 3 && fields[1][0] != '\0') {
+            SnapshotSession *session;
             
-            if (detail_y < height - 4) {
-                attron(COLOR_PAIR(COLOR_HEADER));
-                mvprintw(detail_y, 2, "Components for %s:", projects[selected_project].name);
-                attroff(COLOR_PAIR(COLOR_HEADER));
-                
-                for (i = 0; i < projects[selected_project].num_components; i++) {
-                    if (detail_y + i + 1 >= height - 3) {
-                        break;
-                    }
-                    
-                    attron(COLOR_PAIR(COLOR_NORMAL));
-                    mvprintw(detail_y + i + 1, 4, "- %s", projects[selected_project].components[i]);
-                    attroff(COLOR_PAIR(COLOR_NORMAL));
-                }
+            *sessions = grow_array(*sessions, &capacity, count, sizeof(SnapshotSession));
+            session = &(*sessions)[count++];
+            memset(session, 0, sizeof(*session));
+            session->name = strdup(fields[1]);
+            session->template = strdup(fields[2]);
+        } else if (strcmp(fields[0], "W") == 0 && n >= 4 && count > 0) {
+            SnapshotSession *session = &(*sessions)[count - 1];
+            SnapshotWindow *window;
+            
+            session->windows = grow_array(session->windows, &session->window_capacity, session->window_count,
+                                          sizeof(SnapshotWindow));
+            window = &session->windows[session->window_count++];
+            window->number = atoi(fields[1]);
+            window->cwd = strdup(fields[2]);
+            window->command = strdup(fields[3]);
+        }
+    }
+    free(line);
+    
+    for (i = 0; i < count; i++) {
+        qsort((*sessions)[i].windows, (*sessions)[i].window_count, sizeof(SnapshotWindow), compare_snapshot_windows);
+    }
+    return count;
+}
+
+/*
+ * Script for the first window of a restored session, NULL when a plain
+ * shell will do. It renumbers its window, opens the other windows from
+ * inside the session (screen -X picks the session from $STY) and then runs
+ * its own command the way a launch does, so a later snapshot sees the
+ * same commands again.
+ */
+char *restore_script(const SnapshotSession *session) {
+    const SnapshotWindow *first = &session->windows[0];
+    char *script = NULL, *command;
+    size_t size = 0;
+    FILE *fp;
+    int i;
+    
+    if (session->window_count == 0 ||
+        (session->window_count == 1 && first->number == 0 && first->command[0] == '\0')) {
+        return NULL;
+    }
+    
+    fp = open_memstream(&script, &size);
+    if (fp == NULL) {
+        return NULL;
+    }
+    if (first->number != 0) {
+        fprintf(fp, "screen -X number %d; ", first->number);
+    }
+    for (i = 1; i < session->window_count; i++) {
+        const SnapshotWindow *window = &session->windows[i];
+        
+        fputs("screen -X chdir", fp);
+        if (window->cwd[0] != '\0') {
+            fputc(' ', fp);
+            fput_word(fp, window->cwd);
+        }
+        fprintf(fp, "; screen -X screen %d", window->number);
+        if (window->command[0] != '\0' && asprintf(&command, "%s" SHELL_AFTER, window->command) >= 0) {
+            fputs(" /bin/sh -c ", fp);
+            fput_word(fp, command);
+            free(command);
+        }
+        fputs("; ", fp);
+    }
+    
+    if (first->command[0] == '\0') {
+        fputs("exec \"${SHELL:-/bin/sh}\"", fp);
+    } else if (session->window_count == 1 && first->number == 0) {
+        fprintf(fp, "%s" SHELL_AFTER, first->command);
+    } else if (asprintf(&command, "%s" SHELL_AFTER, first->command) >= 0) {
+        fputs("exec /bin/sh -c ", fp);
+        fput_word(fp, command);
+        free(command);
+    }
+    
+    fclose(fp);
+    return script;
+}
+
+/*
+ * Set up a job recreating a snapshot session, in its first window's
+ * directory (when that still exists) and, for a session launched from a
+ * template, with the template component's environment.
+ */
+void restore_job_init(Job *job, const SnapshotSession *session) {
+    const ProjectComponent *component = NULL;
+    struct stat st;
+    size_t len;
+    int i, j;
+    
+    create_job_init(job, session->name);
+    
+    if (session->window_count > 0 && session->windows[0].cwd[0] != '\0' &&
+        stat(session->windows[0].cwd, &st) == 0 && S_ISDIR(st.st_mode)) {
+        job->cwd = strdup(session->windows[0].cwd);
+    }
+    
+    job->script = restore_script(session);
+    if (job->script != NULL) {
+        create_job_script(job);
+    }
+    
+    if (session->template[0] == '\0') {
+        return;
+    }
+    for (i = 0; i < project_count && component == NULL; i++) {
+        len = strlen(projects[i].name);
+        if (strcmp(projects[i].name, session->template) != 0 ||
+            strncmp(session->name, projects[i].name, len) != 0 || session->name[len] != '_') {
+            continue;
+        }
+        for (j = 0; j < projects[i].num_components; j++) {
+            if (strcmp(projects[i].components[j].name, session->name + len + 1) == 0) {
+                component = &projects[i].components[j];
+                break;
             }
         }
     }
+    job->envp = build_environment(component, session->template);
+}
+
+/* scream snapshot [FILE]: record every session, by default in $XDG_STATE_HOME/scream/snapshot.tsv */
+int cli_snapshot(int argc, char *argv[]) {
+    char path[MAX_PATH_LENGTH];
+    char tmp[MAX_PATH_LENGTH + 8];
+    FILE *fp;
+    int count;
+    
+    if (argc > 2) {
+        fprintf(stderr, "scream snapshot: expected at most one file\n");
+        return EXIT_USAGE;
+    }
+    if (!backend->has_processes) {
+        fprintf(stderr, "scream snapshot: snapshots need the screen backend\n");
+        return EXIT_USAGE;
+    }
+    if (argc == 2) {
+        snprintf(path, sizeof(path), "%s", argv[1]);
+    } else if (state_file_path("snapshot.tsv", path, sizeof(path)) != 0) {
+        fprintf(stderr, "scream snapshot: no state directory (set XDG_STATE_HOME or HOME)\n");
+        return EXIT_FAILURE;
+    }
     
-    /* Draw status message if any */
-    if (strlen(status_message) > 0) {
-        attron(COLOR_PAIR(status_type));
-        mvprintw(height - 2, 2, "Status: %s", status_message);
-        attroff(COLOR_PAIR(status_type));
+    fetch_screens();
+    if (strcmp(path, "-") == 0) {
+        snapshot_write(stdout);
+        return EXIT_SUCCESS;
+    }
+    
+    /* Replace the previous snapshot only once the new one is complete */
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "scream snapshot: cannot write %s: %s\n", tmp, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    count = snapshot_write(fp);
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "scream snapshot: cannot write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return EXIT_FAILURE;
     }
     
-   refresh();
+    printf("%d sessions saved to %s\n", count, path);
+    return EXIT_SUCCESS;
 }
 
-/* Project list menu display */
-void draw_project_list_menu(WINDOW *win) {
-    int i;
-    int start_y = 4;
-    int width, height;
+/* scream restore [FILE]: recreate a snapshot's sessions in parallel, skipping names that exist */
+int cli_restore(int argc, char *argv[]) {
+    char path[MAX_PATH_LENGTH];
+    SnapshotSession *sessions;
+    Job *jobs;
+    FILE *fp;
+    int count, failed = 0;
+    int i, j;
     
-    getmaxyx(win, height, width);
+    if (argc > 2) {
+        fprintf(stderr, "scream restore: expected at most one file\n");
+        return EXIT_USAGE;
+    }
+    if (!backend->has_processes) {
+        fprintf(stderr, "scream restore: snapshots need the screen backend\n");
+        return EXIT_USAGE;
+    }
+    if (argc == 2) {
+        snprintf(path, sizeof(path), "%s", argv[1]);
+    } else if (state_file_path("snapshot.tsv", path, sizeof(path)) != 0) {
+        fprintf(stderr, "scream restore: no state directory (set XDG_STATE_HOME or HOME)\n");
+        return EXIT_FAILURE;
+    }
     
-    wclear(win);
+    fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "scream restore: cannot read %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    count = snapshot_read(fp, &sessions);
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    if (count < 0) {
+        fprintf(stderr, "scream restore: %s is not a version %d snapshot\n", path, SNAPSHOT_VERSION);
+        return EXIT_FAILURE;
+    }
     
-    /* Draw header */
-    attron(COLOR_PAIR(COLOR_HEADER));
-    mvprintw(1, 2, "PROJECT LIST");
-    attroff(COLOR_PAIR(COLOR_HEADER));
+    jobs = calloc(count > 0 ? count : 1, sizeof(Job));
+    if (jobs == NULL) {
+        fprintf(stderr, "scream: out of memory\n");
+        free_snapshot_sessions(sessions, count);
+        return EXIT_FAILURE;
+    }
     
-    /* Draw help text */
-    attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(2, 2, "Use UP/DOWN to navigate, Enter to create screens, r to refresh, q to go back");
-    attroff(COLOR_PAIR(COLOR_HELP));
+    fetch_screens();
+    for (i = 0; i < count; i++) {
+        if (sessions[i].template[0] != '\0') {
+            load_projects();
+            break;
+        }
+    }
     
-    /* If no projects found */
-    if (project_entry_count == 0) {
-        attron(COLOR_PAIR(COLOR_ERROR));
-        mvprintw(start_y + 1, 2, "No projects found.");
-        attroff(COLOR_PAIR(COLOR_ERROR));
-    } else {
-        /* Draw project list with headers */
-        mvprintw(start_y - 1, 2, "%-5s %-30s %-50s", "#", "KEY", "DIRECTORY");
+    /* One fetch up front; existing names are then found through the name index */
+    for (i = 0; i < count; i++) {
+        Job *job = &jobs[i];
+        int exists = screen_find_by_name(sessions[i].name) >= 0;
         
-        /* Draw project entries */
-        for (i = 0; i < project_entry_count; i++) {
-            if (i >= height - start_y - 3) {
-                break; /* Don't draw beyond window height */
-            }
-            
-            if (i == selected_project_entry) {
-                attron(COLOR_PAIR(COLOR_SELECTED));
-                mvprintw(start_y + i, 2, "%-5d %-30s %-50s", 
-                        i + 1, 
-                        project_entries[i].key, 
-                        project_entries[i].directory);
-                attroff(COLOR_PAIR(COLOR_SELECTED));
-            } else {
-                attron(COLOR_PAIR(COLOR_NORMAL));
-                mvprintw(start_y + i, 2, "%-5d %-30s %-50s", 
-                        i + 1, 
-                        project_entries[i].key, 
-                        project_entries[i].directory);
-                attroff(COLOR_PAIR(COLOR_NORMAL));
-            }
+        for (j = 0; j < i && !exists; j++) {
+            exists = strcmp(sessions[j].name, sessions[i].name) == 0;
+        }
+        if (exists) {
+            create_job_init(job, sessions[i].name);
+            job->state = JOB_SKIPPED;
+        } else {
+            restore_job_init(job, &sessions[i]);
         }
     }
     
-    /* Draw status message if any */
-    if (strlen(status_message) > 0) {
-        attron(COLOR_PAIR(status_type));
-        mvprintw(height - 2, 2, "Status: %s", status_message);
-        attroff(COLOR_PAIR(status_type));
-    }
+    run_jobs(jobs, count);
     
-    /* Draw footer */
-    attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(height - 1, 2, "Found %d projects", project_entry_count);
-    attroff(COLOR_PAIR(COLOR_HELP));
+    for (i = 0; i < count; i++) {
+        if (jobs[i].state == JOB_FAILED) {
+            fprintf(stderr, "scream restore: %s: %s\n", jobs[i].target,
+                    jobs[i].result.error[0] ? jobs[i].result.error : "failed");
+            failed++;
+        } else {
+            printf("%s\t%s\n", jobs[i].target, job_state_label(jobs[i].state));
+        }
+        free_job_resources(&jobs[i]);
+    }
+    free(jobs);
+    free_snapshot_sessions(sessions, count);
     
-    refresh();
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-/* Help menu display */
-void draw_help_menu(WINDOW *win) {
-    int width, height;
-    getmaxyx(win, height, width);
+/* scream project list | scream project up TEMPLATE */
+int cli_project(int argc, char *argv[]) {
+    int i, j;
     
-    wclear(win);
+    if (argc < 2 || (strcmp(argv[1], "list") != 0 && strcmp(argv[1], "up") != 0) ||
+        (strcmp(argv[1], "up") == 0 && argc != 3)) {
+        fprintf(stderr, "scream project: expected 'list' or 'up TEMPLATE'\n");
+        return EXIT_USAGE;
+    }
     
-    /* Draw header */
-    attron(COLOR_PAIR(COLOR_HEADER));
-    mvprintw(1, 2, "HELP");
-    attroff(COLOR_PAIR(COLOR_HEADER));
+    load_projects();
+    if (status_type == COLOR_ERROR) {
+        fprintf(stderr, "scream: %s\n", status_message);
+    }
     
-    /* Draw help content */
-    attron(COLOR_PAIR(COLOR_NORMAL));
-    int y = 3;
-    mvprintw(y++, 2, "Scream - A Comprehensive Screen Management Tool");
-    y++;
-    mvprintw(y++, 2, "Main Menu:");
-    mvprintw(y++, 4, "1 or b: Browse screen sessions");
-    mvprintw(y++, 4, "2 or c: Create a new screen session");
-    mvprintw(y++, 4, "3 or k: Kill a screen session");
-    mvprintw(y++, 4, "4 or p: Select a project template");
-    mvprintw(y++, 4, "5, h or ?: Show this help");
-    mvprintw(y++, 4, "6 or l: Load project list and create screens");
-    mvprintw(y++, 4, "q: Quit");
-    y++;
-    mvprintw(y++, 2, "Navigation:");
-    mvprintw(y++, 4, "UP/DOWN: Move selection");
-    mvprintw(y++, 4, "ENTER: Select/Activate");
-    mvprintw(y++, 4, "ESC or q: Go back");
-    mvprintw(y++, 4, "r: Refresh screen list");
-    y++;
-    mvprintw(y++, 2, "Screen Sessions:");
-    mvprintw(y++, 4, "- Browse mode: View and connect to existing sessions");
-    mvprintw(y++, 4, "- Create mode: Start a new named screen session");
-    mvprintw(y++, 4, "- Kill mode: Terminate a screen session");
-    mvprintw(y++, 4, "- Project mode: Create multiple sessions from a template");
-    attroff(COLOR_PAIR(COLOR_NORMAL));
+    if (strcmp(argv[1], "list") == 0) {
+        for (i = 0; i < project_count; i++) {
+            printf("%s\t", projects[i].name);
+            for (j = 0; j < projects[i].num_components; j++) {
+                printf("%s%s", j > 0 ? " " : "", projects[i].components[j].name);
+            }
+            putchar('\n');
+        }
+        return EXIT_SUCCESS;
+    }
     
-    /* Draw footer */
-    attron(COLOR_PAIR(COLOR_HELP));
-    mvprintw(height - 1, 2, "Press any key to return to main menu");
-    attroff(COLOR_PAIR(COLOR_HELP));
+    for (i = 0; i < project_count; i++) {
+        if (strcmp(projects[i].name, argv[2]) == 0) {
+            break;
+        }
+    }
+    if (i == project_count) {
+        fprintf(stderr, "scream project: no template '%s'\n", argv[2]);
+        return EXIT_FAILURE;
+    }
     
-    refresh();
+    create_project_screens(i);
+    
+    for (j = 0; j < launch_job_count; j++) {
+        if (launch_jobs[j].state == JOB_FAILED) {
+            fprintf(stderr, "scream project: %s: %s\n", launch_jobs[j].target,
+                    launch_jobs[j].result.error[0] ? launch_jobs[j].result.error : "failed");
+        } else {
+            printf("%s\t%s\n", launch_jobs[j].target, job_state_label(launch_jobs[j].state));
+        }
+    }
+    
+    return status_type == COLOR_ERROR ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-/* Activate a screen session */
-void activate_screen(int index) {
-    char command[MAX_CMD_LENGTH];
-    
-    endwin(); /* End ncurses mode */
+/* Fill screens[] from a running daemon when there is one, otherwise read the sessions directly */
+int cli_fetch_screens() {
+    char buf[4096];
+    char *line, *end;
+    size_t used = 0;
+    ssize_t n;
+    int fd = daemon_connect();
     
-    printf("\nActivating screen: %s\n", screens[index].full_id);
+    if (fd >= 0 && write(fd, "LIST\n", 5) == 5) {
+        shutdown(fd, SHUT_WR);
+        screen_table_clear();
+        
+        /* "OK <count>" followed by one "id<TAB>status<TAB>created" line per session */
+        while ((n = read(fd, buf + used, sizeof(buf) - 1 - used)) > 0) {
+            used += n;
+            buf[used] = '\0';
+            
+            for (line = buf; (end = strchr(line, '\n')) != NULL; line = end + 1) {
+                Screen screen;
+                char *status, *created;
+                
+                *end = '\0';
+                status = strchr(line, '\t');
+                created = status ? strchr(status + 1, '\t') : NULL;
+                if (created == NULL) {
+                    continue;
+                }
+                *status++ = '\0';
+                *created++ = '\0';
+                
+                if (screen_init(&screen, line, status - line - 1, screen_parse_time(created, strlen(created))) != 0) {
+                    continue;
+                }
+                screen.state = screen_parse_state(status, strlen(status));
+                screen_table_add(&screen);
+            }
+            
+            used -= line - buf;
+            memmove(buf, line, used);
+        }
+        
+        close(fd);
+        return 0;
+    }
     
-    /* Build the command to attach to the screen */
-    sprintf(command, "screen -r %s", screens[index].full_id);
+    if (fd >= 0) {
+        close(fd);
+    }
+    fetch_screens();
+    return 0;
+}
+
+/* Daemon socket: $SCREAM_SOCKET, $XDG_RUNTIME_DIR/scream.sock or /tmp/scream-$UID.sock */
+int daemon_socket_path(struct sockaddr_un *addr) {
+    const char *path = getenv("SCREAM_SOCKET");
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    int len;
     
-    /* Execute the command */
-    system(command);
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
     
-    /* Restart ncurses mode */
-    refresh();
+    if (path != NULL && *path != '\0') {
+        len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", path);
+    } else if (runtime != NULL && *runtime != '\0') {
+        len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/scream.sock", runtime);
+    } else {
+        len = snprintf(addr->sun_path, sizeof(addr->sun_path), "/tmp/scream-%d.sock", (int)getuid());
+    }
     
-    /* Return to main menu */
-    current_menu = MENU_MAIN;
-    set_status("Returned from screen session", COLOR_SUCCESS);
+    return len < (int)sizeof(addr->sun_path) ? 0 : -1;
 }
 
-/* Kill a screen session */
-void kill_screen(int index) {
-    char command[MAX_CMD_LENGTH];
+/* Connect to a running daemon; returns -1 if none is listening */
+int daemon_connect() {
+    struct sockaddr_un addr;
+    int fd;
     
-    /* Build the command to kill the screen */
-    sprintf(command, "screen -S %s -X quit", screens[index].full_id);
+    if (daemon_socket_path(&addr) != 0) {
+        return -1;
+    }
     
-    /* Execute the command */
-    if (system(command) == 0) {
-        set_status("Screen session killed successfully", COLOR_SUCCESS);
-    } else {
-        set_status("Failed to kill screen session", COLOR_ERROR);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
     }
+    
+    return fd;
 }
 
-/* Create a new screen session */
-void create_screen(char *name) {
-    char command[MAX_CMD_LENGTH];
+/* Bind the daemon socket, replacing a stale one but never a live daemon's */
+int daemon_listen() {
+    struct sockaddr_un addr;
+    mode_t mask;
+    int fd, rc;
     
-    /* Build the command to create a new screen */
-    sprintf(command, "screen -dmS %s", name);
+    if (daemon_socket_path(&addr) != 0) {
+        fprintf(stderr, "scream: socket path too long\n");
+        return -1;
+    }
     
-    /* Execute the command */
-    if (system(command) == 0) {
-        set_status("Screen session created successfully", COLOR_SUCCESS);
-    } else {
-        set_status("Failed to create screen session", COLOR_ERROR);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("scream: socket");
+        return -1;
+    }
+    
+    mask = umask(077);
+    rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (rc != 0 && errno == EADDRINUSE) {
+        int probe = daemon_connect();
+        
+        if (probe >= 0) {
+            close(probe);
+            umask(mask);
+            close(fd);
+            fprintf(stderr, "scream: a daemon is already listening on %s\n", addr.sun_path);
+            return -1;
+        }
+        unlink(addr.sun_path);
+        rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    umask(mask);
+    
+    if (rc != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "scream: cannot listen on %s: %s\n", addr.sun_path, strerror(errno));
+        close(fd);
+        return -1;
     }
+    
+    return fd;
 }
 
-/* Load project templates from configuration */
-void load_projects() {
-    /* Initialize with some default projects */
-    project_count = 0;
-    
-    /* Web application project */
-    strcpy(projects[project_count].name, "web-app");
-    strcpy(projects[project_count].components[0], "db");
-    strcpy(projects[project_count].components[1], "api");
-    strcpy(projects[project_count].components[2], "frontend");
-    projects[project_count].num_components = 3;
-    project_count++;
-    
-    /* Data science project */
-    strcpy(projects[project_count].name, "data-science");
-    strcpy(projects[project_count].components[0], "jupyter");
-    strcpy(projects[project_count].components[1], "data-processor");
-    strcpy(projects[project_count].components[2], "visualization");
-    projects[project_count].num_components = 3;
-    project_count++;
-    
-    /* Microservices project */
-    strcpy(projects[project_count].name, "microservices");
-    strcpy(projects[project_count].components[0], "auth-service");
-    strcpy(projects[project_count].components[1], "api-gateway");
-    strcpy(projects[project_count].components[2], "user-service");
-    strcpy(projects[project_count].components[3], "notification-service");
-    strcpy(projects[project_count].components[4], "logging-service");
-    projects[project_count].num_components = 5;
-    project_count++;
-    
-    /* Dev-ops project */
-    strcpy(projects[project_count].name, "devops");
-    strcpy(projects[project_count].components[0], "monitoring");
-    strcpy(projects[project_count].components[1], "build-server");
-    strcpy(projects[project_count].components[2], "staging");
-    strcpy(projects[project_count].components[3], "deployment");
-    projects[project_count].num_components = 4;
-    project_count++;
-    
-    /* TODO: Load more projects from a config file */
-}
-
-/* Load project entries from list-projects script */
-void load_project_entries() {
-    FILE *fp;
-    char line[MAX_LINE_LENGTH];
-    char *key, *directory;
+volatile sig_atomic_t daemon_stop = 0;
+
+/* SIGINT/SIGTERM: leave the loop so the socket is removed */
+void daemon_on_signal(int sig) {
+    (void)sig;
+    daemon_stop = 1;
+}
+
+/*
+ * Resident mode. The session table is kept current by the inotify watch and
+ * served to any number of clients over a Unix stream socket; all clients and
+ * the watch are multiplexed with poll() in a single thread. The protocol is
+ * one request line per command, each answered with "OK <n>" and n data lines
+ * or with "ERR <message>":
+ *
+ *   LIST            every session as id<TAB>status<TAB>created
+ *   GET KEY         one session, by name, pid or full id
+ *   CREATE NAME     create a detached session
+ *   KILL KEY        kill a session
+ *   PING            liveness check
+ */
+int daemon_main() {
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct pollfd *fds = NULL;
+    DaemonClient *clients = NULL;
+    int client_count = 0, client_capacity = 0, fds_capacity = 0;
+    int listen_fd, i;
     
-    /* Clear existing project entries */
-    project_entry_count = 0;
+    listen_fd = daemon_listen();
+    if (listen_fd < 0) {
+        return EXIT_FAILURE;
+    }
     
-    /* Execute list-projects script and capture output */
-    fp = popen("scripts/list-projects", "r");
-    if (fp == NULL) {
-        set_status("Failed to run list-projects script", COLOR_ERROR);
-        return;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = daemon_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    watch_init();
+    if (watch_fd < 0) {
+        fetch_screens();
     }
     
-    /* Read output line by line and parse tab-separated values */
-    while (fgets(line, sizeof(line), fp) != NULL && project_entry_count < MAX_PROJECT_ENTRIES) {
-        /* Remove trailing newline */
-        line[strcspn(line, "\n")] = 0;
+    while (!daemon_stop) {
+        int nfds = 2;
         
-        /* Split by tab */
-        key = strtok(line, "\t");
-        if (key == NULL) {
-            continue;
+        fds = grow_array(fds, &fds_capacity, client_count + 2, sizeof(struct pollfd));
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = watch_fd;
+        fds[1].events = POLLIN;
+        for (i = 0; i < client_count; i++) {
+            fds[nfds].fd = clients[i].fd;
+            fds[nfds].events = clients[i].reply_sent < clients[i].reply_len ? POLLOUT : POLLIN;
+            fds[nfds].revents = 0;
+            nfds++;
         }
         
-        directory = strtok(NULL, "\t");
-        if (directory == NULL) {
-            continue;
+        /* Without a watch, wake up periodically to retry setting one up */
+        if (poll(fds, nfds, watch_fd >= 0 ? -1 : 2000) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
         }
         
-        /* Store data in project_entries array */
-        strncpy(project_entries[project_entry_count].key, key, MAX_NAME_LENGTH - 1);
-        project_entries[project_entry_count].key[MAX_NAME_LENGTH - 1] = '\0';
+        if (watch_fd < 0) {
+            watch_init();
+        } else if (fds[1].revents & POLLIN) {
+            watch_process();
+        }
         
-        strncpy(project_entries[project_entry_count].directory, directory, MAX_LINE_LENGTH - 1);
-        project_entries[project_entry_count].directory[MAX_LINE_LENGTH - 1] = '\0';
+        /* Serve existing clients; closed ones are compacted away */
+        for (i = 0; i < client_count; i++) {
+            DaemonClient *client = &clients[i];
+            short revents = fds[i + 2].revents;
+            int done = 0;
+            
+            if (revents & POLLOUT) {
+                ssize_t n = send(client->fd, client->reply + client->reply_sent,
+                                 client->reply_len - client->reply_sent, MSG_NOSIGNAL);
+                
+                if (n > 0) {
+                    client->reply_sent += n;
+                    if (client->reply_sent == client->reply_len) {
+                        client->reply_sent = client->reply_len = 0;
+                        done = client->read_closed;
+                    }
+                } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                    done = 1;
+                }
+            } else if (client->read_closed) {
+                /* Gone before taking the rest of its reply */
+                done = (revents & (POLLHUP | POLLERR)) != 0;
+            } else if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t n = read(client->fd, client->request + client->request_len,
+                                 sizeof(client->request) - client->request_len);
+                char *line, *end;
+                
+                if (n <= 0) {
+                    done = n == 0 || (errno != EAGAIN && errno != EINTR);
+                } else {
+                    client->request_len += n;
+                    
+                    for (line = client->request;
+                         (end = memchr(line, '\n', client->request + client->request_len - line)) != NULL;
+                         line = end + 1) {
+                        *end = '\0';
+                        daemon_handle_request(client, line);
+                    }
+                    
+                    client->request_len -= line - client->request;
+                    memmove(client->request, line, client->request_len);
+                    if (client->request_len == (int)sizeof(client->request)) {
+                        daemon_reply(client, "ERR request too long\n");
+                        client->request_len = 0;
+                    }
+                }
+                
+                /* Half-closed clients still get their pending reply, as it drains */
+                if (n == 0 && client->reply_sent < client->reply_len) {
+                    client->read_closed = 1;
+                    done = 0;
+                }
+            }
+            
+            if (done) {
+                close(client->fd);
+                free(client->reply);
+                clients[i] = clients[client_count - 1];
+                fds[i + 2] = fds[client_count + 1];
+                client_count--;
+                i--;
+            }
+        }
         
-        project_entry_count++;
+        /* Accept after serving so the pollfd slots above stay aligned */
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            
+            while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                clients = grow_array(clients, &client_capacity, client_count, sizeof(DaemonClient));
+                memset(&clients[client_count], 0, sizeof(DaemonClient));
+                clients[client_count].fd = fd;
+                client_count++;
+            }
+        }
     }
     
-    pclose(fp);
-    
-    if (project_entry_count == 0) {
-        set_status("No projects found or list-projects script failed", COLOR_ERROR);
-    } else {
-        set_status("Loaded project entries successfully", COLOR_SUCCESS);
+    for (i = 0; i < client_count; i++) {
+        close(clients[i].fd);
+        free(clients[i].reply);
+    }
+    free(clients);
+    free(fds);
+    close(listen_fd);
+    if (daemon_socket_path(&addr) == 0) {
+        unlink(addr.sun_path);
     }
+    
+    return EXIT_SUCCESS;
 }
 
-/* Check if a screen with the given name already exists */
-int screen_exists(const char *name) {
-    int i;
+/* Append formatted text to a client's reply buffer */
+void daemon_reply(DaemonClient *client, const char *format, ...) {
+    va_list args;
+    int len;
     
-    /* Make sure we have the latest screen data */
-    fetch_screens();
-    
-    for (i = 0; i < screen_count; i++) {
-        if (strcmp(screens[i].name, name) == 0) {
-            return 1;
+    while (1) {
+        size_t room = client->reply_capacity - client->reply_len;
+        
+        va_start(args, format);
+        len = vsnprintf(client->reply + client->reply_len, room, format, args);
+        va_end(args);
+        
+        if (len < 0) {
+            return;
+        }
+        if ((size_t)len < room) {
+            client->reply_len += len;
+            return;
+        }
+        
+        client->reply_capacity = client->reply_capacity ? client->reply_capacity * 2 : 4096;
+        while (client->reply_capacity - client->reply_len <= (size_t)len) {
+            client->reply_capacity *= 2;
+        }
+        client->reply = realloc(client->reply, client->reply_capacity);
+        if (client->reply == NULL) {
+            fprintf(stderr, "scream: out of memory\n");
+            exit(EXIT_FAILURE);
         }
     }
+}
+
+/* One session line of a reply */
+void daemon_reply_screen(DaemonClient *client, int i) {
+    char created[32];
     
-    return 0;
+    screen_format_time(&screens[i], created, sizeof(created));
+    daemon_reply(client, "%s\t%s\t%s\n", screen_id(&screens[i]), screen_state_names[screens[i].state], created);
 }
 
-/* Create screen sessions for a project template */
-void create_project_screens(int project_index) {
+/* Answer one request line */
+void daemon_handle_request(DaemonClient *client, char *line) {
+    double start = monotonic_us();
+    char *argument;
     int i;
-    char full_name[MAX_NAME_LENGTH * 2];
     
-    if (project_index < 0 || project_index >= project_count) {
-        set_status("Invalid project index", COLOR_ERROR);
-        return;
+    /* CRLF clients: the \r belongs to whichever word ends the line */
+    if (*line != '\0' && line[strlen(line) - 1] == '\r') {
+        line[strlen(line) - 1] = '\0';
     }
-    
-    for (i = 0; i < projects[project_index].num_components; i++) {
-        sprintf(full_name, "%s_%s", projects[project_index].name, 
-                projects[project_index].components[i]);
-        
-        create_screen(full_name);
+    argument = strchr(line, ' ');
+    if (argument != NULL) {
+        *argument++ = '\0';
     }
     
-    set_status("Project screens created", COLOR_SUCCESS);
-}
-
-/* Create a screen for a project entry */
-void create_project_entry_screens(int entry_index) {
-    char screen_name[MAX_NAME_LENGTH];
-    
-    if (entry_index < 0 || entry_index >= project_entry_count) {
-        set_status("Invalid project entry index", COLOR_ERROR);
-        return;
+    /* Pick up changes made by earlier requests in the same batch, or reread without a watch */
+    if (watch_fd >= 0) {
+        watch_process();
+    } else {
+        fetch_screens();
     }
     
-    /* Use the KEY as the screen name */
-    strncpy(screen_name, project_entries[entry_index].key, MAX_NAME_LENGTH - 1);
-    screen_name[MAX_NAME_LENGTH - 1] = '\0';
-    
-    /* Check if a screen with this name already exists */
-    if (screen_exists(screen_name)) {
-        set_status("Screen with this name already exists", COLOR_ERROR);
-        return;
+    if (strcmp(line, "LIST") == 0) {
+        daemon_reply(client, "OK %d\n", screen_count);
+        for (i = 0; i < screen_count; i++) {
+            daemon_reply_screen(client, i);
+        }
+    } else if (strcmp(line, "PING") == 0) {
+        daemon_reply(client, "OK 0\n");
+    } else if (argument == NULL || *argument == '\0') {
+        daemon_reply(client, "ERR unknown request or missing argument\n");
+    } else if (strcmp(line, "GET") == 0) {
+        i = screen_lookup(argument);
+        if (i < 0) {
+            daemon_reply(client, "ERR no session %s\n", argument);
+        } else {
+            daemon_reply(client, "OK 1\n");
+            daemon_reply_screen(client, i);
+        }
+    } else if (strcmp(line, "CREATE") == 0) {
+        if (screen_find_by_name(argument) >= 0) {
+            daemon_reply(client, "ERR session %s already exists\n", argument);
+        } else {
+            create_screen(argument);
+            daemon_reply(client, status_type == COLOR_ERROR ? "ERR %s\n" : "OK 0\n", status_message);
+        }
+    } else if (strcmp(line, "KILL") == 0) {
+        i = screen_lookup(argument);
+        if (i < 0) {
+            daemon_reply(client, "ERR no session %s\n", argument);
+        } else {
+            kill_screen(i);
+            daemon_reply(client, status_type == COLOR_ERROR ? "ERR %s\n" : "OK 0\n", status_message);
+        }
+    } else {
+        daemon_reply(client, "ERR unknown request %s\n", line);
     }
     
-    /* Create the screen with the KEY as the name */
-    create_screen(screen_name);
-    
-    /* Create a message showing what was created */
-    char message[MAX_LINE_LENGTH];
-    snprintf(message, MAX_LINE_LENGTH - 1, "Created screen '%s' for project", 
-            screen_name);
-    set_status(message, COLOR_SUCCESS);
+    stat_record(STAT_REQUEST, start);
 }